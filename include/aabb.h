@@ -1,66 +1,92 @@
-/* Author: Diego Cosin <cosinma@esat-alumni.com>. */
-#ifndef __AABB_H__
-#define __AABB_H__
-
-#include "ray.h"
-
-inline double ffmin(double a, double b) { return a < b ? a : b; }
-inline double ffmax(double a, double b) { return a > b ? a : b; }
-
-class aabb {
- public:
-  aabb() {}
-  aabb(const vec4& a, const vec4& b) { _min = a; _max = b; }
-
-  vec4 min() const {return _min; }
-  vec4 max() const {return _max; }
-
-  // vec3 min() const { return _min; }
-  // vec3 max() const { return _max; }
-  //
-  // bool hit(const ray& r, double t_min, double t_max) const {
-  //   for (int a = 0; a < 3; ++a) {
-  //     double t0 = ffmin((_min[a] - r.origin[a]) / r.direction[a],
-  //                       _max[a] - r.origin[a]) / r.direction[a]);
-  //     double t1 = ffmax((_min[a] - r.origin[a]) / r.direction[a],
-  //                       _max[a] - r.origin[a]) / r.direction[a]);
-  //     t_min = ffmax(t0, t_min);
-  //     t_max = ffmin(t1, t_max);
-  //     if (t_max <= t_min) {
-  //       return false;
-  //     }
-  //   }
-  //   return true;
-  // }
-
-  // Andrew Kensler's version:
-  inline bool hit(const ray& r, double tmin, double tmax) const {
-    for (int a = 0; a < 3; a++) {
-        double invD = 1.0 / r.direction()[a];
-        double t0 = (min()[a] - r.origin()[a]) * invD;
-        double t1 = (max()[a] - r.origin()[a]) * invD;
-        if (invD < 0.0)
-            std::swap(t0, t1);
-        tmin = t0 > tmin ? t0 : tmin;
-        tmax = t1 < tmax ? t1 : tmax;
-        if (tmax <= tmin)
-            return false;
-    }
-    return true;
-  }
-
-  vec4 _min;
-  vec4 _max;
-};
-
-aabb surrounding_box(aabb box0, aabb box1) {
-  vec4 small( ffmin(box0.min().x, box1.min().x),
-              ffmin(box0.min().y, box1.min().y),
-              ffmin(box0.min().z, box1.min().z));
-  vec4 big  ( ffmax(box0.max().x, box1.max().x),
-              ffmax(box0.max().y, box1.max().y),
-              ffmax(box0.max().z, box1.max().z));
-  return aabb(small,big);
-}
-
-#endif
+/* Author: Diego Cosin <cosinma@esat-alumni.com>. */
+#ifndef __AABB_H__
+#define __AABB_H__
+
+#include "ray.h"
+
+inline double ffmin(double a, double b) { return a < b ? a : b; }
+inline double ffmax(double a, double b) { return a > b ? a : b; }
+
+class aabb {
+ public:
+  aabb() {}
+  aabb(const vec4& a, const vec4& b) { bounds[0] = a; bounds[1] = b; }
+
+  vec4 min() const {return bounds[0]; }
+  vec4 max() const {return bounds[1]; }
+
+  // vec3 min() const { return _min; }
+  // vec3 max() const { return _max; }
+  //
+  // bool hit(const ray& r, double t_min, double t_max) const {
+  //   for (int a = 0; a < 3; ++a) {
+  //     double t0 = ffmin((_min[a] - r.origin[a]) / r.direction[a],
+  //                       _max[a] - r.origin[a]) / r.direction[a]);
+  //     double t1 = ffmax((_min[a] - r.origin[a]) / r.direction[a],
+  //                       _max[a] - r.origin[a]) / r.direction[a]);
+  //     t_min = ffmax(t0, t_min);
+  //     t_max = ffmin(t1, t_max);
+  //     if (t_max <= t_min) {
+  //       return false;
+  //     }
+  //   }
+  //   return true;
+  // }
+
+  // Andrew Kensler's version, kept as the reference for the benchmark:
+  inline bool hit_reference(const ray& r, double tmin, double tmax) const {
+    for (int a = 0; a < 3; a++) {
+        double invD = 1.0 / r.direction()[a];
+        double t0 = (min()[a] - r.origin()[a]) * invD;
+        double t1 = (max()[a] - r.origin()[a]) * invD;
+        if (invD < 0.0)
+            std::swap(t0, t1);
+        tmin = t0 > tmin ? t0 : tmin;
+        tmax = t1 < tmax ? t1 : tmax;
+        if (tmax <= tmin)
+            return false;
+    }
+    return true;
+  }
+
+  // Williams et al.'s slab test: the ray's sign bits pick the near and far
+  // planes, so there is no division, swap or early-out branch. The compares
+  // keep the slab value first so a NaN (origin on a plane of a zero-width
+  // slab) leaves the interval unchanged, as in the reference.
+  inline bool hit(const ray& r, double tmin, double tmax) const {
+    const vec4& o = r.A;
+    const vec4& inv = r.inv_B;
+    double tx0 = (bounds[r.sign[0]][0] - o[0]) * inv[0];
+    double tx1 = (bounds[1 - r.sign[0]][0] - o[0]) * inv[0];
+    double ty0 = (bounds[r.sign[1]][1] - o[1]) * inv[1];
+    double ty1 = (bounds[1 - r.sign[1]][1] - o[1]) * inv[1];
+    double tz0 = (bounds[r.sign[2]][2] - o[2]) * inv[2];
+    double tz1 = (bounds[1 - r.sign[2]][2] - o[2]) * inv[2];
+    tmin = tx0 > tmin ? tx0 : tmin;
+    tmin = ty0 > tmin ? ty0 : tmin;
+    tmin = tz0 > tmin ? tz0 : tmin;
+    tmax = tx1 < tmax ? tx1 : tmax;
+    tmax = ty1 < tmax ? ty1 : tmax;
+    tmax = tz1 < tmax ? tz1 : tmax;
+    return tmin < tmax;
+  }
+
+  vec4 bounds[2];
+};
+
+double surface_area(const aabb& b) {
+  vec4 e = b.max() - b.min();
+  return 2.0 * (e.x * e.y + e.y * e.z + e.z * e.x);
+}
+
+aabb surrounding_box(aabb box0, aabb box1) {
+  vec4 small( ffmin(box0.min().x, box1.min().x),
+              ffmin(box0.min().y, box1.min().y),
+              ffmin(box0.min().z, box1.min().z));
+  vec4 big  ( ffmax(box0.max().x, box1.max().x),
+              ffmax(box0.max().y, box1.max().y),
+              ffmax(box0.max().z, box1.max().z));
+  return aabb(small,big);
+}
+
+#endif
@@ -0,0 +1,106 @@
+/* Author: Diego Cosin <cosinma@esat-alumni.com>. */
+#ifndef __ACCUMULATION_H__
+#define __ACCUMULATION_H__ 1
+
+// Partial renders for sample splitting (see render_batch.cc): the pixel_accum
+// sums of one range of samples for every pixel, kept tile by tile in the
+// batch renderer's tile order so a render streams tiles out and a merge
+// streams them back in, whatever the resolution.
+//
+// The header is written with a zero magic and only made valid by close(),
+// so a partial render that died halfway can't be merged by mistake.
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <mutex>
+#include "integrator.h"
+#include "checkpoint.h"
+
+const uint32_t kAccumMagic = 0x43434152;  // "RACC"
+const uint32_t kAccumVersion = 1;
+
+// No padding, it is written as it is
+struct accum_header {
+  uint32_t magic = 0;
+  uint32_t version = 0;
+  // The job every partial of one image shares; 'samples' is the total
+  checkpoint_settings job;
+  int32_t first_sample = 0;
+  int32_t sample_count = 0;
+};
+
+inline bool seek_file(FILE* f, uint64_t offset) {
+#ifdef _WIN32
+  return _fseeki64(f, int64_t(offset), SEEK_SET) == 0;
+#else
+  return fseeko(f, off_t(offset), SEEK_SET) == 0;
+#endif
+}
+
+struct accum_file {
+  FILE* file = nullptr;
+  accum_header header;
+  int tiles_x = 0, tiles_y = 0;
+  size_t tile_pixels = 0;
+  std::mutex mux;
+
+  ~accum_file() {
+    if (file != nullptr) fclose(file);
+  }
+
+  bool create(const char* path, const checkpoint_settings& job, int first, int count) {
+    header.version = kAccumVersion;
+    header.job = job;
+    header.first_sample = first;
+    header.sample_count = count;
+    layout();
+    file = fopen(path, "wb");
+    if (file == nullptr) return false;
+    fwrite(&header, sizeof(header), 1, file);
+    return ferror(file) == 0;
+  }
+
+  bool open(const char* path) {
+    file = fopen(path, "rb");
+    if (file == nullptr) return false;
+    if (fread(&header, sizeof(header), 1, file) != 1 || header.magic != kAccumMagic ||
+        header.version != kAccumVersion || header.job.tile_size < 1) return false;
+    layout();
+    return true;
+  }
+
+  // Tiles may come in any order and from any thread
+  bool write_tile(int t, const pixel_accum* data) {
+    std::lock_guard<std::mutex> lock(mux);
+    return seek_file(file, tile_position(t)) && fwrite(data, sizeof(pixel_accum), tile_pixels, file) == tile_pixels;
+  }
+
+  bool read_tile(int t, pixel_accum* data) {
+    std::lock_guard<std::mutex> lock(mux);
+    return seek_file(file, tile_position(t)) && fread(data, sizeof(pixel_accum), tile_pixels, file) == tile_pixels;
+  }
+
+  // Marks the file complete once every tile is on disk
+  bool close() {
+    header.magic = kAccumMagic;
+    bool ok = sync_file(file) && seek_file(file, 0) && fwrite(&header, sizeof(header), 1, file) == 1;
+    ok = fclose(file) == 0 && ok;
+    file = nullptr;
+    return ok;
+  }
+
+ private:
+  void layout() {
+    const checkpoint_settings& job = header.job;
+    tiles_x = (job.width + job.tile_size - 1) / job.tile_size;
+    tiles_y = (job.height + job.tile_size - 1) / job.tile_size;
+    tile_pixels = size_t(job.tile_size) * job.tile_size;
+  }
+
+  uint64_t tile_position(int t) const {
+    return sizeof(accum_header) + uint64_t(t) * tile_pixels * sizeof(pixel_accum);
+  }
+};
+
+#endif
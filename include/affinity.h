@@ -0,0 +1,172 @@
+/* Author: Diego Cosin <cosinma@esat-alumni.com>. */
+#ifndef __AFFINITY_H__
+#define __AFFINITY_H__ 1
+
+// Pinning render threads to CPUs. The OS is usually right to move threads
+// around, but pinning makes profiles repeatable and keeps a thread next to
+// the memory it first touched on multi-socket machines. Thread i goes to
+// CPU i (or NUMA node i), wrapping around, in the order the OS numbers them.
+//
+// On Windows this has to come after net.h, which wants <winsock2.h> before
+// <windows.h>.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+enum affinity_mode {
+  affinity_none,   // Leave placement to the OS
+  affinity_cores,  // One CPU per thread
+  affinity_nodes   // Any CPU of one NUMA node per thread
+};
+
+affinity_mode parse_affinity_mode(const std::string& name) {
+  if (name == "cores") return affinity_cores;
+  if (name == "nodes") return affinity_nodes;
+  if (name != "none" && !name.empty())
+    fprintf(stderr, "Unknown affinity '%s', leaving threads unpinned\n", name.c_str());
+  return affinity_none;
+}
+
+// CPUs are numbered across processor groups on Windows: group * 64 + bit
+struct cpu_topology {
+  std::vector<int> cpus;                // Every CPU this process may use
+  std::vector<std::vector<int>> nodes;  // The same CPUs, by NUMA node
+};
+
+#ifndef _WIN32
+// "0-3,8,10-11" as in /sys/devices/system/node/node*/cpulist
+inline std::vector<int> parse_cpu_list(const char* text) {
+  std::vector<int> cpus;
+  while (*text != '\0' && *text != '\n') {
+    char* end;
+    long first = strtol(text, &end, 10), last = first;
+    if (end == text) break;
+    if (*end == '-') last = strtol(end + 1, &end, 10);
+    for (long c = first; c <= last; ++c) cpus.push_back(int(c));
+    text = *end == ',' ? end + 1 : end;
+  }
+  return cpus;
+}
+#endif
+
+// Read once; machines don't grow sockets while rendering
+const cpu_topology& topology() {
+  static cpu_topology topo = []() {
+    cpu_topology t;
+#ifdef _WIN32
+    ULONG highest = 0;
+    if (!GetNumaHighestNodeNumber(&highest)) highest = 0;
+    for (ULONG node = 0; node <= highest; ++node) {
+      GROUP_AFFINITY mask;
+      if (!GetNumaNodeProcessorMaskEx(USHORT(node), &mask) || mask.Mask == 0) continue;
+      std::vector<int> cpus;
+      for (int bit = 0; bit < 64; ++bit)
+        if (mask.Mask & (KAFFINITY(1) << bit)) cpus.push_back(mask.Group * 64 + bit);
+      t.nodes.push_back(cpus);
+      t.cpus.insert(t.cpus.end(), cpus.begin(), cpus.end());
+    }
+#else
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) == 0) {
+      for (int c = 0; c < CPU_SETSIZE; ++c)
+        if (CPU_ISSET(c, &allowed)) t.cpus.push_back(c);
+    }
+    for (int node = 0;; ++node) {
+      char path[64];
+      snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", node);
+      FILE* f = fopen(path, "r");
+      if (f == nullptr) break;
+      char line[4096] = { 0 };
+      bool read = fgets(line, sizeof(line), f) != nullptr;
+      fclose(f);
+      if (!read) continue;
+      std::vector<int> cpus;
+      for (int c : parse_cpu_list(line))
+        if (c < CPU_SETSIZE && CPU_ISSET(c, &allowed)) cpus.push_back(c);
+      if (!cpus.empty()) t.nodes.push_back(cpus);
+    }
+#endif
+    if (t.nodes.empty() && !t.cpus.empty()) t.nodes.push_back(t.cpus);
+    return t;
+  }();
+  return topo;
+}
+
+// Restricts the calling thread to 'cpus'; all of them must share a
+// processor group on Windows
+inline bool pin_current_thread_to(const std::vector<int>& cpus) {
+  if (cpus.empty()) return false;
+#ifdef _WIN32
+  GROUP_AFFINITY mask;
+  memset(&mask, 0, sizeof(mask));
+  mask.Group = WORD(cpus[0] / 64);
+  for (int c : cpus)
+    if (c / 64 == cpus[0] / 64) mask.Mask |= KAFFINITY(1) << (c % 64);
+  return SetThreadGroupAffinity(GetCurrentThread(), &mask, nullptr) != 0;
+#else
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  for (int c : cpus) CPU_SET(c, &set);
+  return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#endif
+}
+
+// Pins the calling thread as the index-th render thread
+bool pin_current_thread(int index, affinity_mode mode) {
+  const cpu_topology& t = topology();
+  if (mode == affinity_cores && !t.cpus.empty())
+    return pin_current_thread_to(std::vector<int>(1, t.cpus[index % t.cpus.size()]));
+  if (mode == affinity_nodes && !t.nodes.empty())
+    return pin_current_thread_to(t.nodes[index % t.nodes.size()]);
+  return false;
+}
+
+// Pins the calling thread as the index-th render thread for as long as it
+// lives, then gives the thread back the CPUs it had. For render threads that
+// are the main thread, so the threads it starts between renders (writers,
+// encoders, the denoiser) aren't all confined to render thread 0's CPU.
+class scoped_pin {
+public:
+  scoped_pin(int index, affinity_mode mode) {
+    if (mode == affinity_none) return;
+#ifdef _WIN32
+    saved = GetThreadGroupAffinity(GetCurrentThread(), &mask) != 0;
+#else
+    saved = pthread_getaffinity_np(pthread_self(), sizeof(mask), &mask) == 0;
+#endif
+    if (saved) saved = pin_current_thread(index, mode);
+  }
+  ~scoped_pin() {
+    if (!saved) return;
+#ifdef _WIN32
+    SetThreadGroupAffinity(GetCurrentThread(), &mask, nullptr);
+#else
+    pthread_setaffinity_np(pthread_self(), sizeof(mask), &mask);
+#endif
+  }
+  scoped_pin(const scoped_pin&) = delete;
+  scoped_pin& operator=(const scoped_pin&) = delete;
+
+private:
+#ifdef _WIN32
+  GROUP_AFFINITY mask;
+#else
+  cpu_set_t mask;
+#endif
+  bool saved = false;
+};
+
+#endif
@@ -0,0 +1,97 @@
+/* Author: Diego Cosin <cosinma@esat-alumni.com>. */
+#ifndef __ANIMATION_H__
+#define __ANIMATION_H__ 1
+
+#include <vector>
+#include "camera.h"
+#include "instance.h"
+#include "bvh.h"
+
+// Keyframed value, evaluated with a uniform Catmull-Rom spline through the
+// keys (clamped at both ends). An empty track evaluates to T().
+template <typename T>
+struct track {
+  void add(double time, const T& value) {
+    times.push_back(time);
+    values.push_back(value);
+  }
+
+  T at(double t) const {
+    int n = int(times.size());
+    if (n == 0) return T();
+    if (n == 1 || t <= times[0]) return values[0];
+    if (t >= times[n - 1]) return values[n - 1];
+    int k = 0;
+    while (t > times[k + 1]) k++;
+    double f = (t - times[k]) / (times[k + 1] - times[k]);
+    const T& p0 = values[k > 0 ? k - 1 : k];
+    const T& p1 = values[k];
+    const T& p2 = values[k + 1];
+    const T& p3 = values[k + 2 < n ? k + 2 : k + 1];
+    double f2 = f * f;
+    double f3 = f2 * f;
+    return (p1 * 2.0 + (p2 - p0) * f + (p0 * 2.0 - p1 * 5.0 + p2 * 4.0 - p3) * f2
+            + (p1 * 3.0 - p0 - p2 * 3.0 + p3) * f3) * 0.5;
+  }
+
+  bool empty() const { return times.empty(); }
+
+  std::vector<double> times;
+  std::vector<T> values;
+};
+
+// An instance following a path: 'offset' moves it in world space and 'angle'
+// (degrees) spins it around its own y axis, both on top of 'base'.
+struct animated_instance {
+  instance *target;
+  affine base;
+  track<vec4> offset;
+  track<double> angle;
+
+  affine at(double t) const {
+    return affine::translation(offset.at(t)) * base * affine::rotation_y(angle.at(t));
+  }
+};
+
+// Keyframed camera. The lens, shutter and aspect stay fixed over the path.
+struct camera_path {
+  camera at(double t) const {
+    return camera(lookfrom.at(t), lookat.at(t), vup, vfov.at(t), aspect, aperture, focus_dist, time0, time1);
+  }
+
+  bool empty() const { return lookfrom.empty(); }
+
+  track<vec4> lookfrom;
+  track<vec4> lookat;
+  track<double> vfov;
+  vec4 vup;
+  double aspect;
+  double aperture;
+  double focus_dist;
+  double time0, time1;
+};
+
+// Everything a scene builder hands back to animate a sequence. Animation
+// time runs over [0,1). 'world' is refit (or rebuilt, when the refit tree got
+// too loose) after the objects are moved for each frame.
+struct animation {
+  animation() : world(nullptr) {}
+
+  // Moves the camera and every object to time t. Returns true when the world
+  // was rebuilt instead of refit.
+  bool apply(double t, camera *view) {
+    if (!path.empty())
+      *view = path.at(t);
+    for (size_t i = 0; i < objects.size(); ++i)
+      objects[i].target->set_transform(objects[i].at(t));
+    if (world == nullptr)
+      return false;
+    return world->update();
+  }
+
+  camera_path path;
+  std::vector<animated_instance> objects;
+  dynamic_bvh *world;
+};
+
+#endif
@@ -0,0 +1,245 @@
+/* Author: Diego Cosin <cosinma@esat-alumni.com>. */
+#ifndef __AOV_H__
+#define __AOV_H__ 1
+
+// Arbitrary output variables: the beauty image plus whatever per-pixel data
+// was asked for, kept together in one tiled buffer and exported together.
+
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include "integrator.h"
+#include "ppm.h"
+#include "exr.h"
+#include "framebuffer.h"
+
+enum aov_channel {
+  aov_beauty,        // Linear radiance, the mean of the valid samples
+  aov_albedo,        // First hit albedo (see sample_features)
+  aov_normal,        // First hit shading normal, world space
+  aov_depth,         // Distance from the camera to the first hit
+  aov_sample_count,  // Samples that made it into the average
+  aov_variance,      // Variance of the mean luminance
+  aov_object_id,     // hittable::object_id of the first hit, 0 for background
+  aov_count
+};
+
+const char* aov_names[aov_count] = { "beauty", "albedo", "normal", "depth", "sample_count", "variance", "object_id" };
+const int aov_components[aov_count] = { 3, 3, 3, 1, 1, 1, 1 };
+
+inline unsigned aov_bit(aov_channel c) { return 1u << c; }
+
+// The components of channel 'c' for one pixel
+inline void aov_values(aov_channel c, const vec4& beauty, const pixel_features& f, float* out) {
+  switch (c) {
+    case aov_beauty: out[0] = float(beauty.x); out[1] = float(beauty.y); out[2] = float(beauty.z); break;
+    case aov_albedo: out[0] = float(f.albedo.x); out[1] = float(f.albedo.y); out[2] = float(f.albedo.z); break;
+    case aov_normal: out[0] = float(f.normal.x); out[1] = float(f.normal.y); out[2] = float(f.normal.z); break;
+    case aov_depth: out[0] = float(f.depth); break;
+    case aov_sample_count: out[0] = float(f.samples); break;
+    case aov_variance: out[0] = float(f.variance); break;
+    case aov_object_id: out[0] = float(f.object_id); break;
+    default: break;
+  }
+}
+
+// Comma separated channel names, e.g. "albedo,normal,depth". Beauty is always
+// part of the result; unknown names are reported and skipped.
+unsigned parse_aov_list(const std::string& list) {
+  unsigned mask = aov_bit(aov_beauty);
+  size_t start = 0;
+  while (start < list.size()) {
+    size_t end = list.find(',', start);
+    if (end == std::string::npos) end = list.size();
+    std::string name = list.substr(start, end - start);
+    name.erase(0, name.find_first_not_of(" \t"));
+    name.erase(name.find_last_not_of(" \t") + 1);
+    if (!name.empty()) {
+      int c = 0;
+      while (c < aov_count && name != aov_names[c]) ++c;
+      if (c < aov_count) mask |= aov_bit(aov_channel(c));
+      else fprintf(stderr, "Unknown AOV '%s'\n", name.c_str());
+    }
+    start = end + 1;
+  }
+  return mask;
+}
+
+// Every channel is stored as floats (ids are exact up to 2^24). The image is
+// cut into square tiles and each tile is one contiguous chunk holding all
+// the enabled channels, one plane after another with the components of a
+// pixel interleaved, so a worker storing a pixel, or a filter walking a
+// neighbourhood, stays within a few cache lines. Tiles on the right and
+// bottom edges are padded to full size. The storage is cache-line aligned,
+// so with tiles a multiple of 16 pixels wide every row of a tile's plane is
+// whole cache lines.
+struct aov_buffer {
+  aov_buffer(int w, int h, unsigned channels, int tile = 16)
+    : width(w), height(h), tile_size(tile), mask(channels | aov_bit(aov_beauty)) {
+    tiles_x = (width + tile_size - 1) / tile_size;
+    tiles_y = (height + tile_size - 1) / tile_size;
+    tile_floats = 0;
+    for (int c = 0; c < aov_count; ++c) {
+      if (has(aov_channel(c))) {
+        offset[c] = tile_floats;
+        tile_floats += aov_components[c] * tile_size * tile_size;
+      }
+      else {
+        offset[c] = -1;
+      }
+    }
+    data.assign(size_t(tile_floats) * tiles_x * tiles_y, 0.0f);
+  }
+
+  bool has(aov_channel c) const { return (mask & aov_bit(c)) != 0; }
+
+  // The components of channel 'c' at (x, y); the channel must be enabled
+  float* at(aov_channel c, int x, int y) {
+    return &data[index(c, x, y)];
+  }
+  const float* at(aov_channel c, int x, int y) const {
+    return &data[index(c, x, y)];
+  }
+
+  // Writes every enabled channel of one pixel
+  void store(int x, int y, const vec4& beauty, const pixel_features& f) {
+    for (int c = 0; c < aov_count; ++c)
+      if (has(aov_channel(c))) aov_values(aov_channel(c), beauty, f, at(aov_channel(c), x, y));
+  }
+
+  // Copies pixels [x, x + count) of row y of one channel out, or in,
+  // components interleaved
+  void read_row(aov_channel c, int x, int y, int count, float* out) const {
+    int n = aov_components[c];
+    while (count > 0) {
+      int span = std::min(count, tile_size - x % tile_size);
+      memcpy(out, at(c, x, y), sizeof(float) * n * span);
+      out += n * span;
+      x += span;
+      count -= span;
+    }
+  }
+  void write_row(aov_channel c, int x, int y, int count, const float* in) {
+    int n = aov_components[c];
+    while (count > 0) {
+      int span = std::min(count, tile_size - x % tile_size);
+      memcpy(at(c, x, y), in, sizeof(float) * n * span);
+      in += n * span;
+      x += span;
+      count -= span;
+    }
+  }
+
+  // Copies one channel out as scanlines from the top, components interleaved
+  void read(aov_channel c, float* out) const {
+    for (int y = 0; y < height; ++y)
+      read_row(c, 0, y, width, out + size_t(width) * y * aov_components[c]);
+  }
+
+  void clear() { std::fill(data.begin(), data.end(), 0.0f); }
+
+  int width, height;
+  int tile_size, tiles_x, tiles_y;
+  unsigned mask;
+  // Start of each channel's plane within a tile, -1 when disabled
+  int offset[aov_count];
+  int tile_floats;
+  std::vector<float, cache_aligned_allocator<float>> data;
+
+ private:
+  size_t index(aov_channel c, int x, int y) const {
+    int tx = x / tile_size, ty = y / tile_size;
+    int lx = x - tx * tile_size, ly = y - ty * tile_size;
+    return size_t(tile_floats) * (ty * tiles_x + tx) + offset[c] + size_t(aov_components[c]) * (ly * tile_size + lx);
+  }
+};
+
+// One thread's copy of a row run of every enabled channel (see
+// framebuffer.h), read in, stored into pixel by pixel and written back whole
+struct aov_run {
+  int x0 = 0, y0 = 0, width = 0;
+  unsigned mask = 0;
+  std::vector<float> planes[aov_count];
+
+  void load(const aov_buffer& aovs, int x, int y, int w) {
+    x0 = x;
+    y0 = y;
+    width = w;
+    mask = aovs.mask;
+    for (int c = 0; c < aov_count; ++c) {
+      if (!aovs.has(aov_channel(c))) continue;
+      if (planes[c].size() < size_t(w) * aov_components[c]) planes[c].resize(size_t(w) * aov_components[c]);
+      aovs.read_row(aov_channel(c), x, y, w, planes[c].data());
+    }
+  }
+
+  void store(int x, const vec4& beauty, const pixel_features& f) {
+    for (int c = 0; c < aov_count; ++c)
+      if ((mask & aov_bit(aov_channel(c))) != 0)
+        aov_values(aov_channel(c), beauty, f, &planes[c][size_t(x - x0) * aov_components[c]]);
+  }
+
+  void flush(aov_buffer& aovs) const {
+    for (int c = 0; c < aov_count; ++c)
+      if ((mask & aov_bit(aov_channel(c))) != 0) aovs.write_row(aov_channel(c), x0, y0, width, planes[c].data());
+  }
+};
+
+// Writes every enabled channel as <base>_<name>.pfm
+bool write_aovs(const char* base, const aov_buffer& aovs) {
+  std::vector<float> plane;
+  bool ok = true;
+  for (int c = 0; c < aov_count; ++c) {
+    if (!aovs.has(aov_channel(c))) continue;
+    plane.resize(size_t(aovs.width) * aovs.height * aov_components[c]);
+    aovs.read(aov_channel(c), plane.data());
+    std::string path = std::string(base) + "_" + aov_names[c] + ".pfm";
+    ok = write_pfm(path.c_str(), plane.data(), aovs.width, aovs.height, aov_components[c]) && ok;
+  }
+  return ok;
+}
+
+// EXR channels for every enabled AOV, pointing into 'planes' (filled here
+// with a scanline copy of each). Beauty is the unprefixed R, G, B and depth
+// the standard Z; counts and ids are always stored as float so they stay
+// exact.
+std::vector<exr_channel> aov_exr_channels(const aov_buffer& aovs, std::vector<std::vector<float>>& planes, exr_pixel_type type) {
+  static const char* const component_names[aov_count][3] = {
+    { "R", "G", "B" },
+    { "albedo.R", "albedo.G", "albedo.B" },
+    { "normal.X", "normal.Y", "normal.Z" },
+    { "Z" },
+    { "sample_count" },
+    { "variance" },
+    { "object_id" }
+  };
+  planes.resize(aov_count);
+  std::vector<exr_channel> channels;
+  for (int c = 0; c < aov_count; ++c) {
+    if (!aovs.has(aov_channel(c))) continue;
+    int n = aov_components[c];
+    planes[c].resize(size_t(aovs.width) * aovs.height * n);
+    aovs.read(aov_channel(c), planes[c].data());
+    bool exact = c == aov_sample_count || c == aov_object_id;
+    for (int k = 0; k < n; ++k) {
+      exr_channel ch;
+      ch.name = component_names[c][k];
+      ch.type = exact ? exr_float : type;
+      ch.data = planes[c].data() + k;
+      ch.stride = n;
+      channels.push_back(ch);
+    }
+  }
+  return channels;
+}
+
+// Writes every enabled channel into one EXR
+bool write_aovs_exr(const char* path, const aov_buffer& aovs, const exr_options& opt) {
+  std::vector<std::vector<float>> planes;
+  std::vector<exr_channel> channels = aov_exr_channels(aovs, planes, opt.pixel_type);
+  return write_exr(path, aovs.width, aovs.height, channels, opt);
+}
+
+#endif
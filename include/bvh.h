@@ -1,114 +1,294 @@
-/* Author: Diego Cosin <cosinma@esat-alumni.com>. */
-#ifndef __BVH_H__
-#define __BVH_H__ 1
-
-#include "hittable.h"
-#include "random.h"
-
-class bvh_node : public hittable {
- public:
-  bvh_node() {}
-  bvh_node(hittable **l, int n, double time0, double time1);
-
-  virtual bool hit(const ray& r, double t_min, double t_max, hit_record& rec) const;
-  virtual bool bounding_box(double t0, double t1, aabb& box) const;
-
-  hittable *left;
-  hittable *right;
-  aabb box;
-};
-
-bool bvh_node::hit(const ray& r, double t_min, double t_max, hit_record& rec) const {
-  if (box.hit(r, t_min, t_max)) {
-    hit_record left_rec, right_rec;
-    bool hit_left = left->hit(r, t_min, t_max, left_rec);
-    bool hit_right = right->hit(r, t_min, t_max, right_rec);
-    if (hit_left && hit_right) {
-      if (left_rec.t < right_rec.t)
-        rec = left_rec;
-      else
-        rec = right_rec;
-      return true;
-    }
-    else if (hit_left) {
-      rec = left_rec;
-      return true;
-    }
-    else if (hit_right) {
-      rec = right_rec;
-      return true;
-    }
-    else
-      return false;
-  }
-  else return false;
-}
-bool bvh_node::bounding_box(double t0, double t1, aabb& b) const {
-  b = box;
-  return true;
-}
-int box_x_compare (const void * a, const void * b) {
-  aabb box_left, box_right;
-  hittable *ah = *(hittable**)a;
-  hittable *bh = *(hittable**)b;
-  if(!ah->bounding_box(0,0, box_left) || !bh->bounding_box(0,0, box_right))
-    std::cerr << "no bounding box in bvh_node constructor\n";
-  if (box_left.min().x - box_right.min().x < 0.0)
-    return -1;
-  else
-    return 1;
-}
-int box_y_compare (const void * a, const void * b) {
-  aabb box_left, box_right;
-  hittable *ah = *(hittable**)a;
-  hittable *bh = *(hittable**)b;
-  if(!ah->bounding_box(0,0, box_left) || !bh->bounding_box(0,0, box_right))
-    std::cerr << "no bounding box in bvh_node constructor\n";
-  if (box_left.min().y - box_right.min().y < 0.0)
-    return -1;
-  else
-    return 1;
-}
-int box_z_compare (const void * a, const void * b) {
-  aabb box_left, box_right;
-  hittable *ah = *(hittable**)a;
-  hittable *bh = *(hittable**)b;
-  if(!ah->bounding_box(0,0, box_left) || !bh->bounding_box(0,0, box_right))
-    std::cerr << "no bounding box in bvh_node constructor\n";
-  if (box_left.min().z - box_right.min().z < 0.0)
-    return -1;
-  else
-    return 1;
-}
-bvh_node::bvh_node(hittable **l, int n, double time0, double time1) {
-  int axis = int(3*random_double());
-
-  if (axis == 0)
-    qsort(l, n, sizeof(hittable *), box_x_compare);
-  else if (axis == 1)
-    qsort(l, n, sizeof(hittable *), box_y_compare);
-  else
-    qsort(l, n, sizeof(hittable *), box_z_compare);
-
-  if (n == 1) {
-    left = right = l[0];
-  }
-  else if (n == 2) {
-    left = l[0];
-    right = l[1];
-  }
-  else {
-    left = new bvh_node(l, n/2, time0, time1);
-    right = new bvh_node(l + n/2, n - n/2, time0, time1);
-  }
-
-  aabb box_left, box_right;
-
-  if (!left->bounding_box(time0, time1, box_left) ||
-      !right->bounding_box(time0, time1, box_right)) {
-        std::cerr << "no bounding box in bvh_node constructor" << std::endl;
-  }
-
-  box = surrounding_box(box_left, box_right);
-}
-#endif
+/* Author: Diego Cosin <cosinma@esat-alumni.com>. */
+#ifndef __BVH_H__
+#define __BVH_H__ 1
+
+#include <algorithm>
+#include <thread>
+#include <vector>
+#include "hittable.h"
+#include "random.h"
+#include "stats.h"
+#include "trace.h"
+#include "thread_pool.h"
+
+// Nodes keep their bounds at both ends of the shutter interval. When those
+// differ (something below moves), the box is interpolated at the ray's time
+// instead of testing the union over the whole interval, which keeps culling
+// tight around fast moving primitives. Linear interpolation of the end boxes
+// is conservative for any child that moves linearly.
+class bvh_node : public hittable {
+ public:
+  bvh_node() : owns_children(false) { kind = hk_bvh; }
+  bvh_node(hittable **l, int n, double time0, double time1);
+  ~bvh_node();
+
+  virtual bool hit(const ray& r, double t_min, double t_max, hit_record& rec) const;
+  virtual bool bounding_box(double t0, double t1, aabb& box) const;
+  aabb box_at(double time) const;
+  void update_bounds();
+  void refit();
+  void subtrees(int depth, std::vector<bvh_node*>& out);
+  void refit_above(int depth);
+  double area_sum() const;
+
+  hittable *left;
+  hittable *right;
+  aabb box;        // Union over the shutter interval
+  aabb box0;       // Bounds at time0
+  vec4 dmin;       // box1.min() - box0.min()
+  vec4 dmax;       // box1.max() - box0.max()
+  double time0;
+  double time1;
+  double inv_duration;
+  bool moving;
+  bool owns_children; // Children are nodes this one built (n > 2)
+};
+
+bvh_node::~bvh_node() {
+  if (owns_children) {
+    delete static_cast<bvh_node*>(left);
+    delete static_cast<bvh_node*>(right);
+  }
+}
+
+aabb bvh_node::box_at(double time) const {
+  double f = (time - time0) * inv_duration;
+  f = ffmin(ffmax(f, 0.0), 1.0);
+  return aabb(box0.min() + dmin * f, box0.max() + dmax * f);
+}
+
+bool bvh_node::hit(const ray& r, double t_min, double t_max, hit_record& rec) const {
+  STAT_INC(bvh_nodes_visited);
+  if (moving ? box_at(r.time()).hit(r, t_min, t_max) : box.hit(r, t_min, t_max)) {
+    hit_record left_rec, right_rec;
+    bool hit_left = dispatch_hit(left, r, t_min, t_max, left_rec);
+    bool hit_right = dispatch_hit(right, r, t_min, t_max, right_rec);
+    if (hit_left && hit_right) {
+      if (left_rec.t < right_rec.t)
+        rec = left_rec;
+      else
+        rec = right_rec;
+      return true;
+    }
+    else if (hit_left) {
+      rec = left_rec;
+      return true;
+    }
+    else if (hit_right) {
+      rec = right_rec;
+      return true;
+    }
+    else
+      return false;
+  }
+  else return false;
+}
+bool bvh_node::bounding_box(double t0, double t1, aabb& b) const {
+  if (moving)
+    b = surrounding_box(box_at(t0), box_at(t1));
+  else
+    b = box;
+  return true;
+}
+int box_x_compare (const void * a, const void * b) {
+  aabb box_left, box_right;
+  hittable *ah = *(hittable**)a;
+  hittable *bh = *(hittable**)b;
+  if(!ah->bounding_box(0,0, box_left) || !bh->bounding_box(0,0, box_right))
+    std::cerr << "no bounding box in bvh_node constructor\n";
+  if (box_left.min().x - box_right.min().x < 0.0)
+    return -1;
+  else
+    return 1;
+}
+int box_y_compare (const void * a, const void * b) {
+  aabb box_left, box_right;
+  hittable *ah = *(hittable**)a;
+  hittable *bh = *(hittable**)b;
+  if(!ah->bounding_box(0,0, box_left) || !bh->bounding_box(0,0, box_right))
+    std::cerr << "no bounding box in bvh_node constructor\n";
+  if (box_left.min().y - box_right.min().y < 0.0)
+    return -1;
+  else
+    return 1;
+}
+int box_z_compare (const void * a, const void * b) {
+  aabb box_left, box_right;
+  hittable *ah = *(hittable**)a;
+  hittable *bh = *(hittable**)b;
+  if(!ah->bounding_box(0,0, box_left) || !bh->bounding_box(0,0, box_right))
+    std::cerr << "no bounding box in bvh_node constructor\n";
+  if (box_left.min().z - box_right.min().z < 0.0)
+    return -1;
+  else
+    return 1;
+}
+bvh_node::bvh_node(hittable **l, int n, double time0, double time1) {
+  kind = hk_bvh;
+  int axis = int(3*random_double());
+
+  if (axis == 0)
+    qsort(l, n, sizeof(hittable *), box_x_compare);
+  else if (axis == 1)
+    qsort(l, n, sizeof(hittable *), box_y_compare);
+  else
+    qsort(l, n, sizeof(hittable *), box_z_compare);
+
+  owns_children = n > 2;
+  this->time0 = time0;
+  this->time1 = time1;
+  if (n == 1) {
+    left = right = l[0];
+  }
+  else if (n == 2) {
+    left = l[0];
+    right = l[1];
+  }
+  else {
+    left = new bvh_node(l, n/2, time0, time1);
+    right = new bvh_node(l + n/2, n - n/2, time0, time1);
+  }
+
+  update_bounds();
+}
+
+void bvh_node::update_bounds() {
+  aabb left0, right0, left1, right1;
+
+  if (!left->bounding_box(time0, time0, left0) ||
+      !right->bounding_box(time0, time0, right0) ||
+      !left->bounding_box(time1, time1, left1) ||
+      !right->bounding_box(time1, time1, right1)) {
+        std::cerr << "no bounding box in bvh_node constructor" << std::endl;
+  }
+
+  box0 = surrounding_box(left0, right0);
+  aabb box1 = surrounding_box(left1, right1);
+  box = surrounding_box(box0, box1);
+  dmin = box1.min() - box0.min();
+  dmax = box1.max() - box0.max();
+  inv_duration = time1 > time0 ? 1.0 / (time1 - time0) : 0.0;
+  moving = dmin.x != 0.0 || dmin.y != 0.0 || dmin.z != 0.0 ||
+           dmax.x != 0.0 || dmax.y != 0.0 || dmax.z != 0.0;
+}
+
+// Recomputes bounds bottom-up after primitives moved, keeping the topology.
+// Leaves that are bvh_nodes built elsewhere (an instance's bottom-level
+// tree, say) are treated as rigid and left alone.
+void bvh_node::refit() {
+  if (owns_children) {
+    static_cast<bvh_node*>(left)->refit();
+    static_cast<bvh_node*>(right)->refit();
+  }
+  update_bounds();
+}
+
+// The nodes 'depth' levels down (or leaves above that), which can be refit
+// independently of each other
+void bvh_node::subtrees(int depth, std::vector<bvh_node*>& out) {
+  if (depth == 0 || !owns_children) {
+    out.push_back(this);
+    return;
+  }
+  static_cast<bvh_node*>(left)->subtrees(depth - 1, out);
+  static_cast<bvh_node*>(right)->subtrees(depth - 1, out);
+}
+
+// Refits the top 'depth' levels once the subtrees below them are done
+void bvh_node::refit_above(int depth) {
+  if (depth == 0 || !owns_children) return;
+  static_cast<bvh_node*>(left)->refit_above(depth - 1);
+  static_cast<bvh_node*>(right)->refit_above(depth - 1);
+  update_bounds();
+}
+
+// Shared by every animated scene, started the first time one is refit
+thread_pool& refit_pool() {
+  static thread_pool pool(std::max(1, int(std::thread::hardware_concurrency())) - 1);
+  return pool;
+}
+
+// Sum of the surface areas of this node and every node it built; divided by
+// the root's own area it is the usual SAH estimate of traversal cost.
+double bvh_node::area_sum() const {
+  double sum = surface_area(box);
+  if (owns_children) {
+    sum += static_cast<const bvh_node*>(left)->area_sum();
+    sum += static_cast<const bvh_node*>(right)->area_sum();
+  }
+  return sum;
+}
+
+// Top-level structure for animated scenes. update() refits the tree when
+// primitives have moved and only rebuilds it from scratch once the refit
+// tree's SAH cost has grown past rebuild_ratio times its cost at build time.
+class dynamic_bvh : public hittable {
+ public:
+  dynamic_bvh(hittable **l, int n, double time0, double time1, double rebuild_ratio = 1.5);
+  ~dynamic_bvh();
+  virtual bool hit(const ray& r, double t_min, double t_max, hit_record& rec) const {
+    return root->bvh_node::hit(r, t_min, t_max, rec);
+  }
+  virtual bool bounding_box(double t0, double t1, aabb& box) const {
+    return root->bvh_node::bounding_box(t0, t1, box);
+  }
+  bool update();
+  void rebuild();
+  double cost() const;
+
+  hittable **list;
+  int list_size;
+  bvh_node *root;
+  double time0, time1;
+  double rebuild_ratio;
+  double built_cost;
+};
+
+dynamic_bvh::dynamic_bvh(hittable **l, int n, double t0, double t1, double ratio)
+  : list_size(n), root(nullptr), time0(t0), time1(t1), rebuild_ratio(ratio) {
+  kind = hk_dynamic_bvh;
+  // bvh_node sorts its input in place, keep a private copy to rebuild from
+  list = new hittable*[n];
+  for (int i = 0; i < n; ++i) list[i] = l[i];
+  rebuild();
+}
+
+dynamic_bvh::~dynamic_bvh() {
+  delete root;
+  delete[] list;
+}
+
+double dynamic_bvh::cost() const {
+  double root_area = surface_area(root->box);
+  return root_area > 0.0 ? root->area_sum() / root_area : 0.0;
+}
+
+void dynamic_bvh::rebuild() {
+  TRACE_SCOPE("bvh build", "bvh");
+  delete root;
+  root = new bvh_node(list, list_size, time0, time1);
+  built_cost = cost();
+}
+
+// Returns true when the tree had to be rebuilt. The subtrees at one split
+// level, about four per thread for balance, are refit on the pool and the
+// levels above them on this thread.
+bool dynamic_bvh::update() {
+  thread_pool& pool = refit_pool();
+  int depth = 0;
+  for (int parts = 1; parts < 4 * pool.size() && pool.size() > 1; parts *= 2)
+    depth++;
+  {
+    TRACE_SCOPE("bvh refit", "bvh");
+    std::vector<bvh_node*> parts;
+    root->subtrees(depth, parts);
+    pool.run(int(parts.size()), [&parts](int i) { parts[i]->refit(); });
+    root->refit_above(depth);
+  }
+  if (cost() > built_cost * rebuild_ratio) {
+    rebuild();
+    return true;
+  }
+  return false;
+}
+#endif
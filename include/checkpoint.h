@@ -0,0 +1,130 @@
+/* Author: Diego Cosin <cosinma@esat-alumni.com>. */
+#ifndef __CHECKPOINT_H__
+#define __CHECKPOINT_H__ 1
+
+// Resume state of a batch render (see render_batch.cc). Every pixel reseeds
+// the generator from the seed, its position and the block of kSampleBlock
+// samples it is drawing (sample_block_seed in accumulate_pixel), so no RNG
+// state has to be saved: the finished tiles already in the output file plus
+// the settings that produced them are enough to finish the image exactly as
+// an uninterrupted run would have.
+//
+// Checkpoints are written to a temporary file, flushed to disk and renamed
+// over the previous one, so a crash at any point leaves either the old or
+// the new checkpoint, never a torn one.
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+const uint32_t kCheckpointMagic = 0x54504b43;  // "CKPT"
+const uint32_t kCheckpointVersion = 2;
+
+// Everything that changes the pixels or the file layout
+struct checkpoint_settings {
+  int32_t width;
+  int32_t height;
+  int32_t samples;
+  int32_t scene_index;
+  double max_sample_luminance;
+  uint32_t seed;
+  int32_t tile_size;
+  uint32_t aov_mask;
+  int32_t pixel_type;
+  int32_t compression;
+
+  // Zeroes the padding too, it is written and hashed with the rest
+  checkpoint_settings() { memset(this, 0, sizeof(*this)); }
+};
+
+struct batch_checkpoint {
+  checkpoint_settings settings;
+  // Where the output file ends after the last finished tile
+  uint64_t file_end = 0;
+  // Per tile, its offset in the output file, 0 if not finished
+  std::vector<uint64_t> tile_offsets;
+};
+
+// FNV-1a, to catch a truncated or damaged checkpoint
+inline uint64_t checkpoint_hash(const void* data, size_t size, uint64_t h = 14695981039346656037ull) {
+  const uint8_t* bytes = static_cast<const uint8_t*>(data);
+  for (size_t i = 0; i < size; ++i) {
+    h ^= bytes[i];
+    h *= 1099511628211ull;
+  }
+  return h;
+}
+
+// Makes what was written to 'f' durable, not just handed to the OS
+bool sync_file(FILE* f) {
+  if (fflush(f) != 0) return false;
+#ifdef _WIN32
+  return _commit(_fileno(f)) == 0;
+#else
+  return fsync(fileno(f)) == 0;
+#endif
+}
+
+bool replace_file(const char* from, const char* to) {
+#ifdef _WIN32
+  return MoveFileExA(from, to, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+#else
+  return rename(from, to) == 0;
+#endif
+}
+
+bool save_checkpoint(const char* path, const batch_checkpoint& ck) {
+  std::string tmp = std::string(path) + ".tmp";
+  FILE* f = fopen(tmp.c_str(), "wb");
+  if (f == nullptr) return false;
+  uint64_t count = ck.tile_offsets.size();
+  uint64_t h = checkpoint_hash(&ck.settings, sizeof(ck.settings));
+  h = checkpoint_hash(&ck.file_end, sizeof(ck.file_end), h);
+  h = checkpoint_hash(ck.tile_offsets.data(), count * sizeof(uint64_t), h);
+
+  fwrite(&kCheckpointMagic, sizeof(kCheckpointMagic), 1, f);
+  fwrite(&kCheckpointVersion, sizeof(kCheckpointVersion), 1, f);
+  fwrite(&ck.settings, sizeof(ck.settings), 1, f);
+  fwrite(&ck.file_end, sizeof(ck.file_end), 1, f);
+  fwrite(&count, sizeof(count), 1, f);
+  fwrite(ck.tile_offsets.data(), sizeof(uint64_t), count, f);
+  fwrite(&h, sizeof(h), 1, f);
+  bool ok = ferror(f) == 0 && sync_file(f);
+  ok = fclose(f) == 0 && ok;
+  return ok && replace_file(tmp.c_str(), path);
+}
+
+bool load_checkpoint(const char* path, batch_checkpoint& ck) {
+  FILE* f = fopen(path, "rb");
+  if (f == nullptr) return false;
+  uint32_t magic = 0, version = 0;
+  uint64_t count = 0, stored_hash = 0;
+  bool ok = fread(&magic, sizeof(magic), 1, f) == 1 && magic == kCheckpointMagic &&
+            fread(&version, sizeof(version), 1, f) == 1 && version == kCheckpointVersion &&
+            fread(&ck.settings, sizeof(ck.settings), 1, f) == 1 &&
+            fread(&ck.file_end, sizeof(ck.file_end), 1, f) == 1 &&
+            fread(&count, sizeof(count), 1, f) == 1 && count < (1ull << 32);
+  if (ok) {
+    ck.tile_offsets.resize(size_t(count));
+    ok = fread(ck.tile_offsets.data(), sizeof(uint64_t), size_t(count), f) == count &&
+         fread(&stored_hash, sizeof(stored_hash), 1, f) == 1;
+  }
+  fclose(f);
+  if (!ok) return false;
+  uint64_t h = checkpoint_hash(&ck.settings, sizeof(ck.settings));
+  h = checkpoint_hash(&ck.file_end, sizeof(ck.file_end), h);
+  h = checkpoint_hash(ck.tile_offsets.data(), size_t(count) * sizeof(uint64_t), h);
+  return h == stored_hash;
+}
+
+#endif
@@ -0,0 +1,175 @@
+/* Author: Diego Cosin <cosinma@esat-alumni.com>. */
+#ifndef __DENOISE_H__
+#define __DENOISE_H__ 1
+
+#include <math.h>
+#include <vector>
+#include <thread>
+#include <algorithm>
+#include <memory>
+#include "aov.h"
+#include "thread_pool.h"
+
+// The AOVs the filter is guided by
+const unsigned denoise_aovs = aov_bit(aov_albedo) | aov_bit(aov_normal) | aov_bit(aov_depth) | aov_bit(aov_variance);
+
+// Scanline copies of the guiding AOVs, rows from the top
+struct feature_buffers {
+  explicit feature_buffers(const aov_buffer& aovs)
+    : width(aovs.width), height(aovs.height), albedo(3 * width * height), normal(3 * width * height), depth(width * height), variance(width * height) {
+    aovs.read(aov_albedo, albedo.data());
+    aovs.read(aov_normal, normal.data());
+    aovs.read(aov_depth, depth.data());
+    aovs.read(aov_variance, variance.data());
+  }
+
+  int width, height;
+  std::vector<float> albedo;
+  std::vector<float> normal;
+  std::vector<float> depth;
+  std::vector<float> variance;
+};
+
+struct denoise_params {
+  int iterations = 5;
+  // Luminance edge stop, in standard deviations of the pixel's estimate
+  float sigma_luminance = 8.0f;
+  // Exponent on the normal dot product
+  float sigma_normal = 64.0f;
+  // Relative depth difference, per pixel of filter step
+  float sigma_depth = 0.02f;
+  int threads = 0;
+};
+
+// The filter's threads, kept from one frame to the next and only restarted
+// when a different count is asked for
+thread_pool& denoise_pool(int threads) {
+  static std::unique_ptr<thread_pool> pool;
+  if (pool == nullptr || pool->size() != threads) {
+    pool.reset();
+    pool.reset(new thread_pool(threads - 1));
+  }
+  return *pool;
+}
+
+// Runs body(y0, y1) over [0, height) split into one band per thread of 'pool'.
+template <typename F>
+void parallel_rows(int height, thread_pool& pool, F body) {
+  int threads = pool.size();
+  if (threads <= 1 || height < 2 * threads) {
+    body(0, height);
+    return;
+  }
+  int band = (height + threads - 1) / threads;
+  pool.run((height + band - 1) / band, [&](int i) {
+    body(i * band, std::min(height, (i + 1) * band));
+  });
+}
+
+// Edge-avoiding a-trous wavelet filter (Dammertz et al. 2010) with the
+// variance guided luminance weight of SVGF (Schied et al. 2017).
+//
+// Works on 'rgba' in place: the gamma corrected framebuffer with 'stride'
+// floats per pixel. Color is linearized and divided by the albedo so the
+// filter only smooths lighting and texture detail survives; each pass widens
+// the 5x5 B3 spline kernel by doubling its step.
+void denoise(float* rgba, int stride, const feature_buffers& f, const denoise_params& p) {
+  const int w = f.width;
+  const int h = f.height;
+  const size_t n = size_t(w) * h;
+  const float kernel[3] = { 3.0f / 8.0f, 1.0f / 4.0f, 1.0f / 16.0f };
+  const float eps = 1e-4f;
+  int threads = p.threads > 0 ? p.threads : int(std::thread::hardware_concurrency());
+  thread_pool& pool = denoise_pool(threads > 1 ? threads : 1);
+
+  std::vector<float> irradiance(3 * n), next(3 * n);
+  std::vector<float> var(f.variance), next_var(n), blurred_var(n);
+  for (size_t i = 0; i < n; ++i) {
+    float a_lum = 0.0f;
+    for (int c = 0; c < 3; ++c) {
+      float lin = rgba[stride * i + c] * rgba[stride * i + c];
+      float a = std::max(f.albedo[3 * i + c], eps);
+      irradiance[3 * i + c] = lin / a;
+      a_lum += a / 3.0f;
+    }
+    var[i] /= a_lum * a_lum;
+  }
+
+  for (int it = 0, step = 1; it < p.iterations; ++it, step <<= 1) {
+    // Per-pixel variance from a few samples is itself noisy (a pixel whose
+    // samples all missed the light has none), so the luminance weight uses a
+    // 3x3 gaussian of it.
+    parallel_rows(h, pool, [&](int y0, int y1) {
+      for (int y = y0; y < y1; ++y) {
+        for (int x = 0; x < w; ++x) {
+          float sum = 0.0f, wsum = 0.0f;
+          for (int dy = -1; dy <= 1; ++dy) {
+            for (int dx = -1; dx <= 1; ++dx) {
+              int yy = y + dy, xx = x + dx;
+              if (yy < 0 || yy >= h || xx < 0 || xx >= w) continue;
+              float wk = (dx == 0 ? 0.5f : 0.25f) * (dy == 0 ? 0.5f : 0.25f);
+              sum += wk * var[size_t(w) * yy + xx];
+              wsum += wk;
+            }
+          }
+          blurred_var[size_t(w) * y + x] = sum / wsum;
+        }
+      }
+    });
+
+    parallel_rows(h, pool, [&](int y0, int y1) {
+      for (int y = y0; y < y1; ++y) {
+        for (int x = 0; x < w; ++x) {
+          size_t i = size_t(w) * y + x;
+          const float* ci = &irradiance[3 * i];
+          const float* ni = &f.normal[3 * i];
+          float li = 0.2126f * ci[0] + 0.7152f * ci[1] + 0.0722f * ci[2];
+          float zi = f.depth[i];
+          float l_scale = 1.0f / (p.sigma_luminance * sqrtf(blurred_var[i]) + eps);
+          float z_scale = 1.0f / (p.sigma_depth * step * std::max(zi, eps) + eps);
+
+          float sum[3] = { 0.0f, 0.0f, 0.0f };
+          float wsum = 0.0f, vsum = 0.0f;
+          for (int dy = -2; dy <= 2; ++dy) {
+            int yy = y + dy * step;
+            if (yy < 0 || yy >= h) continue;
+            for (int dx = -2; dx <= 2; ++dx) {
+              int xx = x + dx * step;
+              if (xx < 0 || xx >= w) continue;
+              size_t j = size_t(w) * yy + xx;
+              const float* cj = &irradiance[3 * j];
+              const float* nj = &f.normal[3 * j];
+              float lj = 0.2126f * cj[0] + 0.7152f * cj[1] + 0.0722f * cj[2];
+              float nd = ni[0] * nj[0] + ni[1] * nj[1] + ni[2] * nj[2];
+              // Background pixels have a zero normal and only blend together
+              float wn = (nd > 0.0f) ? powf(nd, p.sigma_normal) : ((ni[0] == 0.0f && ni[1] == 0.0f && ni[2] == 0.0f &&
+                                                                    nj[0] == 0.0f && nj[1] == 0.0f && nj[2] == 0.0f) ? 1.0f : 0.0f);
+              float wz = expf(-fabsf(zi - f.depth[j]) * z_scale);
+              float wl = expf(-fabsf(li - lj) * l_scale);
+              float wk = kernel[dx < 0 ? -dx : dx] * kernel[dy < 0 ? -dy : dy] * wn * wz * wl;
+              sum[0] += wk * cj[0];
+              sum[1] += wk * cj[1];
+              sum[2] += wk * cj[2];
+              wsum += wk;
+              vsum += wk * wk * var[j];
+            }
+          }
+          // The center tap always has weight kernel[0]^2, so wsum > 0
+          for (int c = 0; c < 3; ++c) next[3 * i + c] = sum[c] / wsum;
+          next_var[i] = vsum / (wsum * wsum);
+        }
+      }
+    });
+    irradiance.swap(next);
+    var.swap(next_var);
+  }
+
+  for (size_t i = 0; i < n; ++i) {
+    for (int c = 0; c < 3; ++c) {
+      float lin = irradiance[3 * i + c] * std::max(f.albedo[3 * i + c], eps);
+      rgba[stride * i + c] = sqrtf(std::max(lin, 0.0f));
+    }
+  }
+}
+
+#endif
@@ -0,0 +1,128 @@
+/* Author: Diego Cosin <cosinma@esat-alumni.com>. */
+#ifndef __DISPATCH_H__
+#define __DISPATCH_H__ 1
+
+// Closed-set dispatch for the hot path. Every built-in primitive, material,
+// texture and pdf carries a kind tag; the functions below switch on it and
+// call the concrete member with a qualified name, which skips the vtable and
+// lets the compiler inline intersection and shading. Anything tagged *_other
+// (user extensions) goes through the regular virtual call.
+//
+// Build with RT_STATIC_DISPATCH=0 to always use the virtual calls.
+
+#ifndef RT_STATIC_DISPATCH
+#define RT_STATIC_DISPATCH 1
+#endif
+
+#include "hittable.h"
+#include "random.h"
+#include "hittable_list.h"
+#include "sphere.h"
+#include "sphere_set.h"
+#include "aarect.h"
+#include "bvh.h"
+#include "instance.h"
+#include "texture.h"
+#include "material.h"
+#include "pdf.h"
+
+bool dispatch_hit(const hittable* h, const ray& r, double t_min, double t_max, hit_record& rec) {
+#if RT_STATIC_DISPATCH
+  switch (h->kind) {
+    case hk_sphere:        return static_cast<const sphere*>(h)->sphere::hit(r, t_min, t_max, rec);
+    case hk_moving_sphere: return static_cast<const moving_sphere*>(h)->moving_sphere::hit(r, t_min, t_max, rec);
+    case hk_sphere_set:    return static_cast<const sphere_set*>(h)->sphere_set::hit(r, t_min, t_max, rec);
+    case hk_xy_rect:       return static_cast<const xy_rect*>(h)->xy_rect::hit(r, t_min, t_max, rec);
+    case hk_xz_rect:       return static_cast<const xz_rect*>(h)->xz_rect::hit(r, t_min, t_max, rec);
+    case hk_yz_rect:       return static_cast<const yz_rect*>(h)->yz_rect::hit(r, t_min, t_max, rec);
+    case hk_box:           return static_cast<const box*>(h)->box::hit(r, t_min, t_max, rec);
+    case hk_flip_normals:  return static_cast<const flip_normals*>(h)->flip_normals::hit(r, t_min, t_max, rec);
+    case hk_translate:     return static_cast<const translate*>(h)->translate::hit(r, t_min, t_max, rec);
+    case hk_rotate_y:      return static_cast<const rotate_y*>(h)->rotate_y::hit(r, t_min, t_max, rec);
+    case hk_list:          return static_cast<const hittable_list*>(h)->hittable_list::hit(r, t_min, t_max, rec);
+    case hk_bvh:           return static_cast<const bvh_node*>(h)->bvh_node::hit(r, t_min, t_max, rec);
+    case hk_dynamic_bvh:   return static_cast<const dynamic_bvh*>(h)->dynamic_bvh::hit(r, t_min, t_max, rec);
+    case hk_instance:      return static_cast<const instance*>(h)->instance::hit(r, t_min, t_max, rec);
+    default: break;
+  }
+#endif
+  return h->hit(r, t_min, t_max, rec);
+}
+
+vec4 dispatch_value(const texture* t, double u, double v, const vec4& p) {
+#if RT_STATIC_DISPATCH
+  switch (t->kind) {
+    case tk_constant: return static_cast<const constant_texture*>(t)->constant_texture::value(u, v, p);
+    case tk_checker:  return static_cast<const checker_texture*>(t)->checker_texture::value(u, v, p);
+    case tk_noise:    return static_cast<const noise_texture*>(t)->noise_texture::value(u, v, p);
+    case tk_image:    return static_cast<const image_texture*>(t)->image_texture::value(u, v, p);
+    default: break;
+  }
+#endif
+  return t->value(u, v, p);
+}
+
+bool dispatch_scatter(const material* m, const ray& r_in, const hit_record& hrec, scatter_record& srec) {
+#if RT_STATIC_DISPATCH
+  switch (m->kind) {
+    case mk_lambertian:    return static_cast<const lambertian*>(m)->lambertian::scatter(r_in, hrec, srec);
+    case mk_metal:         return static_cast<const metal*>(m)->metal::scatter(r_in, hrec, srec);
+    case mk_dielectric:    return static_cast<const dielectric*>(m)->dielectric::scatter(r_in, hrec, srec);
+    case mk_diffuse_light: return static_cast<const diffuse_light*>(m)->diffuse_light::scatter(r_in, hrec, srec);
+    default: break;
+  }
+#endif
+  return m->scatter(r_in, hrec, srec);
+}
+
+double dispatch_scattering_pdf(const material* m, const ray& r_in, const hit_record& rec, const ray& scattered) {
+#if RT_STATIC_DISPATCH
+  switch (m->kind) {
+    case mk_lambertian:    return static_cast<const lambertian*>(m)->lambertian::scattering_pdf(r_in, rec, scattered);
+    case mk_metal:         return static_cast<const metal*>(m)->metal::scattering_pdf(r_in, rec, scattered);
+    case mk_dielectric:    return static_cast<const dielectric*>(m)->dielectric::scattering_pdf(r_in, rec, scattered);
+    case mk_diffuse_light: return static_cast<const diffuse_light*>(m)->diffuse_light::scattering_pdf(r_in, rec, scattered);
+    default: break;
+  }
+#endif
+  return m->scattering_pdf(r_in, rec, scattered);
+}
+
+vec4 dispatch_emitted(const material* m, const ray& r_in, const hit_record& rec, double u, double v, const vec4& p) {
+#if RT_STATIC_DISPATCH
+  switch (m->kind) {
+    case mk_lambertian:    return static_cast<const lambertian*>(m)->lambertian::emitted(r_in, rec, u, v, p);
+    case mk_metal:         return static_cast<const metal*>(m)->metal::emitted(r_in, rec, u, v, p);
+    case mk_dielectric:    return static_cast<const dielectric*>(m)->dielectric::emitted(r_in, rec, u, v, p);
+    case mk_diffuse_light: return static_cast<const diffuse_light*>(m)->diffuse_light::emitted(r_in, rec, u, v, p);
+    default: break;
+  }
+#endif
+  return m->emitted(r_in, rec, u, v, p);
+}
+
+double dispatch_pdf_value(const pdf* p, const vec4& direction) {
+#if RT_STATIC_DISPATCH
+  switch (p->kind) {
+    case pk_cosine:   return static_cast<const cosine_pdf*>(p)->cosine_pdf::value(direction);
+    case pk_hittable: return static_cast<const hittable_pdf*>(p)->hittable_pdf::value(direction);
+    case pk_mixture:  return static_cast<const mixture_pdf*>(p)->mixture_pdf::value(direction);
+    default: break;
+  }
+#endif
+  return p->value(direction);
+}
+
+vec4 dispatch_generate(const pdf* p) {
+#if RT_STATIC_DISPATCH
+  switch (p->kind) {
+    case pk_cosine:   return static_cast<const cosine_pdf*>(p)->cosine_pdf::generate();
+    case pk_hittable: return static_cast<const hittable_pdf*>(p)->hittable_pdf::generate();
+    case pk_mixture:  return static_cast<const mixture_pdf*>(p)->mixture_pdf::generate();
+    default: break;
+  }
+#endif
+  return p->generate();
+}
+
+#endif
@@ -0,0 +1,356 @@
+/* Author: Diego Cosin <cosinma@esat-alumni.com>. */
+#ifndef __EXR_H__
+#define __EXR_H__ 1
+
+// Minimal single-part OpenEXR writer: scanline or tiled (one level), half or
+// float channels, stored raw or with ZIP/ZIPS compression. Blocks are
+// independent, so write_exr() encodes them on every core and then writes
+// them in order behind the offset table; exr_tile_stream appends tiles in
+// whatever order they finish, for images that never exist in memory whole.
+//
+// ZIP uses the deflate coder of stb_image_write, so a translation unit that
+// includes this must also build it (STB_IMAGE_WRITE_IMPLEMENTATION).
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <algorithm>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#include <sys/types.h>
+#endif
+
+extern "C" unsigned char* stbi_zlib_compress(unsigned char* data, int data_len, int* out_len, int quality);
+
+enum exr_pixel_type {
+  exr_half = 1,
+  exr_float = 2
+};
+
+enum exr_compression {
+  exr_no_compression = 0,
+  exr_zips = 2,  // One scanline per block
+  exr_zip = 3    // Sixteen scanlines per block
+};
+
+struct exr_channel {
+  std::string name;
+  exr_pixel_type type;
+  // Pixel (x, y) is data[stride * (width * y + x)], rows from the top
+  const float* data;
+  int stride;
+};
+
+struct exr_options {
+  exr_pixel_type pixel_type = exr_half;
+  exr_compression compression = exr_zip;
+  bool tiled = false;
+  int tile_size = 64;
+  int threads = 0;
+};
+
+// Round to nearest even; overflow goes to infinity and NaN stays NaN
+inline uint16_t float_to_half(float f) {
+  uint32_t x;
+  memcpy(&x, &f, sizeof(x));
+  uint32_t sign = (x >> 16) & 0x8000;
+  uint32_t abs_x = x & 0x7fffffff;
+  if (abs_x >= 0x7f800000) return uint16_t(sign | 0x7c00 | (abs_x > 0x7f800000 ? 0x200 : 0));
+  if (abs_x >= 0x477ff000) return uint16_t(sign | 0x7c00);
+  if (abs_x < 0x38800000) {
+    // Subnormal half, in units of 2^-24
+    if (abs_x < 0x33000000) return uint16_t(sign);
+    uint32_t mantissa = (abs_x & 0x7fffff) | 0x800000;
+    int shift = 126 - int(abs_x >> 23);
+    uint32_t r = mantissa >> shift;
+    uint32_t rest = mantissa & ((1u << shift) - 1);
+    uint32_t halfway = 1u << (shift - 1);
+    if (rest > halfway || (rest == halfway && (r & 1))) r++;
+    return uint16_t(sign | r);
+  }
+  uint32_t r = (abs_x - 0x38000000) >> 13;
+  uint32_t rest = abs_x & 0x1fff;
+  if (rest > 0x1000 || (rest == 0x1000 && (r & 1))) r++;
+  return uint16_t(sign | r);
+}
+
+// Little endian output, whatever the host
+struct exr_bytes {
+  std::vector<uint8_t> data;
+
+  void u8(uint8_t v) { data.push_back(v); }
+  void u16(uint16_t v) { u8(uint8_t(v)); u8(uint8_t(v >> 8)); }
+  void u32(uint32_t v) { u16(uint16_t(v)); u16(uint16_t(v >> 16)); }
+  void u64(uint64_t v) { u32(uint32_t(v)); u32(uint32_t(v >> 32)); }
+  void i32(int32_t v) { u32(uint32_t(v)); }
+  void f32(float v) { uint32_t u; memcpy(&u, &v, sizeof(u)); u32(u); }
+  void str(const std::string& s) { data.insert(data.end(), s.begin(), s.end()); u8(0); }
+  void attribute(const char* name, const char* type, uint32_t size) { str(name); str(type); u32(size); }
+  void pixel(float v, exr_pixel_type type) { if (type == exr_half) u16(float_to_half(v)); else f32(v); }
+};
+
+// The ZIP predictor: split even and odd bytes, then delta code them
+std::vector<uint8_t> exr_zip_block(const std::vector<uint8_t>& raw) {
+  size_t n = raw.size();
+  std::vector<uint8_t> tmp(n);
+  size_t half = (n + 1) / 2;
+  for (size_t i = 0; i < n; ++i)
+    tmp[(i & 1) ? half + i / 2 : i / 2] = raw[i];
+  for (size_t i = n - 1; i > 0; --i)
+    tmp[i] = uint8_t(int(tmp[i]) - int(tmp[i - 1]) + 128);
+
+  int out_size = 0;
+  unsigned char* packed = stbi_zlib_compress(tmp.data(), int(n), &out_size, 8);
+  std::vector<uint8_t> result;
+  // A block that doesn't shrink is stored as is; readers tell by its size
+  if (packed != nullptr && size_t(out_size) < n) result.assign(packed, packed + out_size);
+  else result = raw;
+  free(packed);
+  return result;
+}
+
+// Readers expect the channel list, and the data, in name order
+void exr_sort_channels(std::vector<exr_channel>& channels) {
+  std::sort(channels.begin(), channels.end(), [](const exr_channel& a, const exr_channel& b) { return a.name < b.name; });
+}
+
+// Packs the pixels [x0,x1) x [y0,y1) of 'channels' (sorted, 'width' pixels
+// per row) into one block: for every line, every channel in turn.
+std::vector<uint8_t> exr_encode_block(const std::vector<exr_channel>& channels, int width, int x0, int y0, int x1, int y1, exr_compression compression) {
+  exr_bytes raw;
+  for (int y = y0; y < y1; ++y)
+    for (size_t c = 0; c < channels.size(); ++c)
+      for (int x = x0; x < x1; ++x)
+        raw.pixel(channels[c].data[size_t(channels[c].stride) * (size_t(width) * y + x)], channels[c].type);
+  return compression == exr_no_compression ? raw.data : exr_zip_block(raw.data);
+}
+
+// Everything up to the offset table. Tiles may be stored in any order as
+// long as the header says so ('random_order').
+void exr_write_header(exr_bytes& header, int width, int height, const std::vector<exr_channel>& channels, const exr_options& opt, bool random_order) {
+  header.u32(20000630);
+  header.u32(opt.tiled ? 2 | 0x200 : 2);
+
+  uint32_t chlist_size = 1;
+  for (size_t c = 0; c < channels.size(); ++c) chlist_size += uint32_t(channels[c].name.size()) + 1 + 16;
+  header.attribute("channels", "chlist", chlist_size);
+  for (size_t c = 0; c < channels.size(); ++c) {
+    header.str(channels[c].name);
+    header.i32(channels[c].type);
+    header.u32(0);  // pLinear and reserved
+    header.i32(1);  // x sampling
+    header.i32(1);  // y sampling
+  }
+  header.u8(0);
+  header.attribute("compression", "compression", 1);
+  header.u8(uint8_t(opt.compression));
+  header.attribute("dataWindow", "box2i", 16);
+  header.i32(0); header.i32(0); header.i32(width - 1); header.i32(height - 1);
+  header.attribute("displayWindow", "box2i", 16);
+  header.i32(0); header.i32(0); header.i32(width - 1); header.i32(height - 1);
+  header.attribute("lineOrder", "lineOrder", 1);
+  header.u8(random_order ? 2 : 0);  // Random or increasing y
+  header.attribute("pixelAspectRatio", "float", 4);
+  header.f32(1.0f);
+  header.attribute("screenWindowCenter", "v2f", 8);
+  header.f32(0.0f); header.f32(0.0f);
+  header.attribute("screenWindowWidth", "float", 4);
+  header.f32(1.0f);
+  if (opt.tiled) {
+    header.attribute("tiles", "tiledesc", 9);
+    header.u32(uint32_t(opt.tile_size));
+    header.u32(uint32_t(opt.tile_size));
+    header.u8(0);  // One level, rounding down
+  }
+  header.u8(0);
+}
+
+bool write_exr(const char* path, int width, int height, std::vector<exr_channel> channels, const exr_options& opt) {
+  exr_sort_channels(channels);
+
+  int block_w = opt.tiled ? opt.tile_size : width;
+  int block_h = opt.tiled ? opt.tile_size : (opt.compression == exr_zip ? 16 : 1);
+  int blocks_x = (width + block_w - 1) / block_w;
+  int blocks_y = (height + block_h - 1) / block_h;
+  int block_count = blocks_x * blocks_y;
+
+  // Encode every block, spread over the threads
+  std::vector<std::vector<uint8_t>> blocks(block_count);
+  std::atomic<int> next(0);
+  auto encode = [&]() {
+    for (int b = next++; b < block_count; b = next++) {
+      int x0 = (b % blocks_x) * block_w, y0 = (b / blocks_x) * block_h;
+      int x1 = std::min(width, x0 + block_w), y1 = std::min(height, y0 + block_h);
+      blocks[b] = exr_encode_block(channels, width, x0, y0, x1, y1, opt.compression);
+    }
+  };
+  int threads = opt.threads > 0 ? opt.threads : int(std::thread::hardware_concurrency());
+  threads = std::max(1, std::min(threads, block_count));
+  std::vector<std::thread> pool;
+  for (int i = 1; i < threads; ++i) pool.push_back(std::thread(encode));
+  encode();
+  for (size_t i = 0; i < pool.size(); ++i) pool[i].join();
+
+  exr_bytes header;
+  exr_write_header(header, width, height, channels, opt, false);
+
+  // Offset table, then the blocks with their coordinates and sizes
+  uint64_t offset = header.data.size() + 8 * size_t(block_count);
+  for (int b = 0; b < block_count; ++b) {
+    header.u64(offset);
+    offset += (opt.tiled ? 20 : 8) + blocks[b].size();
+  }
+
+  FILE* f = fopen(path, "wb");
+  if (f == nullptr) return false;
+  fwrite(header.data.data(), 1, header.data.size(), f);
+  for (int b = 0; b < block_count; ++b) {
+    exr_bytes chunk;
+    if (opt.tiled) {
+      chunk.i32(b % blocks_x);
+      chunk.i32(b / blocks_x);
+      chunk.i32(0);
+      chunk.i32(0);
+    }
+    else {
+      chunk.i32((b / blocks_x) * block_h);
+    }
+    chunk.u32(uint32_t(blocks[b].size()));
+    fwrite(chunk.data.data(), 1, chunk.data.size(), f);
+    fwrite(blocks[b].data(), 1, blocks[b].size(), f);
+  }
+  bool ok = ferror(f) == 0;
+  return fclose(f) == 0 && ok;
+}
+
+// A tiled EXR written one tile at a time. The offset table is reserved up
+// front and filled in by close(), so only the tiles being handed in are ever
+// in memory. write_tile() may be called from several threads: tiles are
+// compressed by the caller and only the append is serialized.
+struct exr_tile_stream {
+  FILE* file = nullptr;
+  int width = 0, height = 0;
+  int tiles_x = 0, tiles_y = 0;
+  exr_options options;
+  uint64_t table_position = 0;
+  uint64_t end = 0;
+  std::vector<uint64_t> offsets;
+  std::mutex mux;
+
+  // 'channels' only describes the layout here, its data is not read
+  bool open(const char* path, int w, int h, std::vector<exr_channel> channels, const exr_options& opt) {
+    exr_bytes header;
+    layout(w, h, channels, opt, header);
+    file = fopen(path, "wb");
+    if (file == nullptr) return false;
+    fwrite(header.data.data(), 1, header.data.size(), file);
+    end = header.data.size();
+    return ferror(file) == 0;
+  }
+
+  // Continues a file left by an earlier run with the same layout, keeping
+  // the tiles in 'done' (offsets as returned by snapshot()). Anything past
+  // 'done_end' was written after that snapshot and is cut off.
+  bool resume(const char* path, int w, int h, std::vector<exr_channel> channels, const exr_options& opt,
+              const std::vector<uint64_t>& done, uint64_t done_end) {
+    exr_bytes header;
+    layout(w, h, channels, opt, header);
+    if (done.size() != offsets.size() || done_end < header.data.size()) return false;
+    file = fopen(path, "r+b");
+    if (file == nullptr) return false;
+    // The header must match byte for byte, or the tiles mean something else
+    std::vector<uint8_t> existing(table_position);
+    if (fread(existing.data(), 1, existing.size(), file) != existing.size() ||
+        memcmp(existing.data(), header.data.data(), existing.size()) != 0) {
+      fclose(file);
+      file = nullptr;
+      return false;
+    }
+    offsets = done;
+    end = done_end;
+    fflush(file);
+#ifdef _WIN32
+    bool ok = _chsize_s(_fileno(file), int64_t(end)) == 0 && _fseeki64(file, int64_t(end), SEEK_SET) == 0;
+#else
+    bool ok = ftruncate(fileno(file), off_t(end)) == 0 && fseeko(file, off_t(end), SEEK_SET) == 0;
+#endif
+    return ok;
+  }
+
+  // Consistent copy of the finished tiles, with everything they refer to
+  // flushed to the OS
+  void snapshot(std::vector<uint64_t>& done, uint64_t& done_end) {
+    std::lock_guard<std::mutex> lock(mux);
+    fflush(file);
+    done = offsets;
+    done_end = end;
+  }
+
+  // Tile (tx, ty) with data laid out for a width of tile_size (edge tiles
+  // only fill the pixels inside the image)
+  bool write_tile(int tx, int ty, std::vector<exr_channel> channels) {
+    exr_sort_channels(channels);
+    int x1 = std::min(options.tile_size, width - tx * options.tile_size);
+    int y1 = std::min(options.tile_size, height - ty * options.tile_size);
+    std::vector<uint8_t> block = exr_encode_block(channels, options.tile_size, 0, 0, x1, y1, options.compression);
+    exr_bytes chunk;
+    chunk.i32(tx);
+    chunk.i32(ty);
+    chunk.i32(0);
+    chunk.i32(0);
+    chunk.u32(uint32_t(block.size()));
+
+    std::lock_guard<std::mutex> lock(mux);
+    offsets[size_t(tiles_x) * ty + tx] = end;
+    fwrite(chunk.data.data(), 1, chunk.data.size(), file);
+    fwrite(block.data(), 1, block.size(), file);
+    end += chunk.data.size() + block.size();
+    return ferror(file) == 0;
+  }
+
+  // Fails, leaving an unreadable file, if any tile is missing
+  bool close() {
+    if (file == nullptr) return false;
+    bool complete = std::find(offsets.begin(), offsets.end(), uint64_t(0)) == offsets.end();
+    exr_bytes table;
+    for (size_t i = 0; i < offsets.size(); ++i) table.u64(offsets[i]);
+    // The table sits right after the header, well within fseek's range
+    fseek(file, long(table_position), SEEK_SET);
+    fwrite(table.data.data(), 1, table.data.size(), file);
+    bool ok = ferror(file) == 0;
+    ok = fclose(file) == 0 && ok;
+    file = nullptr;
+    return ok && complete;
+  }
+
+  ~exr_tile_stream() {
+    if (file != nullptr) fclose(file);
+  }
+
+ private:
+  void layout(int w, int h, std::vector<exr_channel>& channels, const exr_options& opt, exr_bytes& header) {
+    width = w;
+    height = h;
+    options = opt;
+    options.tiled = true;
+    tiles_x = (width + options.tile_size - 1) / options.tile_size;
+    tiles_y = (height + options.tile_size - 1) / options.tile_size;
+    offsets.assign(size_t(tiles_x) * tiles_y, 0);
+
+    exr_sort_channels(channels);
+    exr_write_header(header, width, height, channels, options, true);
+    table_position = header.data.size();
+    // Placeholder table, overwritten by close()
+    for (size_t i = 0; i < offsets.size(); ++i) header.u64(0);
+  }
+};
+
+#endif
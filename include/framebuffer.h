@@ -0,0 +1,117 @@
+/* Author: Diego Cosin <cosinma@esat-alumni.com>. */
+#ifndef __FRAMEBUFFER_H__
+#define __FRAMEBUFFER_H__ 1
+
+// Writing pixels from many threads without false sharing. Threads that store
+// neighbouring pixels straight into a shared image keep taking the same
+// cache lines from each other, which costs more than the pixels as the
+// thread count grows. Instead every thread renders a run of kRunPixels
+// pixels of one row into its own pixel_run and copies it out in one go;
+// runs start on multiples of kRunPixels and the image is cache-line
+// aligned, so two threads only meet on the lines at the ends of the rows,
+// when a row isn't a whole number of lines. The per-pixel side buffers
+// (which pixels are done, their cost, the AOVs) are staged and written back
+// the same way.
+
+#include <stdlib.h>
+#include <string.h>
+#include <new>
+#include <vector>
+#include <xmmintrin.h>
+
+const int kCacheLine = 64;
+// 16 cache lines of RGBA floats, and one of per-pixel bytes
+const int kRunPixels = 64;
+
+// A cache-line aligned image, left uninitialised: the first write to a page
+// places it on the NUMA node of the thread doing it, and that should be a
+// render thread, not the one allocating. Release with free_framebuffer.
+float* new_framebuffer(int width, int height, int channels) {
+  return (float*)_mm_malloc(size_t(width) * height * channels * sizeof(float), kCacheLine);
+}
+
+void free_framebuffer(float* image) {
+  _mm_free(image);
+}
+
+// For std::vector storage that starts on a cache line
+template <typename T>
+struct cache_aligned_allocator {
+  typedef T value_type;
+
+  cache_aligned_allocator() {}
+  template <typename U> cache_aligned_allocator(const cache_aligned_allocator<U>&) {}
+
+  T* allocate(size_t n) {
+    void* p = _mm_malloc(n * sizeof(T), kCacheLine);
+    if (p == nullptr) throw std::bad_alloc();
+    return (T*)p;
+  }
+  void deallocate(T* p, size_t) { _mm_free(p); }
+};
+
+template <typename T, typename U>
+bool operator==(const cache_aligned_allocator<T>&, const cache_aligned_allocator<U>&) { return true; }
+template <typename T, typename U>
+bool operator!=(const cache_aligned_allocator<T>&, const cache_aligned_allocator<U>&) { return false; }
+
+// Columns [x, x + run_width(x, accuracy, width)) form the run starting at x;
+// with blocks of 'accuracy' pixels it is a whole number of blocks
+inline int run_width(int x, int accuracy, int width) {
+  int blocks = kRunPixels > accuracy ? kRunPixels / accuracy : 1;
+  int w = blocks * accuracy;
+  return x + w < width ? w : width - x;
+}
+
+// One thread's private copy of the run it is rendering
+struct pixel_run {
+  int x0 = 0, width = 0, channels = 0;
+  std::vector<float> pixels;
+
+  void begin(int x, int w, int components) {
+    x0 = x;
+    width = w;
+    channels = components;
+    // Grows once, on the thread that owns it
+    if (pixels.size() < size_t(w) * components) pixels.resize(size_t(w) * components);
+  }
+
+  float* at(int x) { return &pixels[size_t(x - x0) * channels]; }
+
+  // Fills columns [x, x + count) of the run with one value
+  void fill(int x, int count, const float* value) {
+    if (x + count > x0 + width) count = x0 + width - x;
+    for (int i = 0; i < count; ++i) memcpy(at(x + i), value, channels * sizeof(float));
+  }
+
+  // Copies the run into rows [y0, y1) of 'image'
+  void flush(float* image, int image_width, int y0, int y1) const {
+    for (int y = y0; y < y1; ++y)
+      memcpy(image + (size_t(image_width) * y + x0) * channels, pixels.data(), size_t(width) * channels * sizeof(float));
+  }
+};
+
+// The same for one value per pixel, e.g. the rendered flags or the cost of
+// each pixel, which have to keep what is there: the run is read in first
+// and written back whole
+template <typename T>
+struct value_run {
+  int x0 = 0, width = 0;
+  std::vector<T> values;
+
+  // Starts the run at column x of 'row'
+  void load(const T* row, int x, int w) {
+    x0 = x;
+    width = w;
+    if (values.size() < size_t(w)) values.resize(w);
+    memcpy(values.data(), row + x, size_t(w) * sizeof(T));
+  }
+
+  T& at(int x) { return values[x - x0]; }
+
+  void flush(T* row) const {
+    memcpy(row + x0, values.data(), size_t(width) * sizeof(T));
+  }
+};
+
+#endif
@@ -0,0 +1,93 @@
+/* Author: Diego Cosin <cosinma@esat-alumni.com>. */
+#ifndef __HEATMAP_H__
+#define __HEATMAP_H__ 1
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <algorithm>
+#include <stb/stb_image_write.h>
+#include "stats.h"
+#include "ppm.h"
+
+// Per-pixel cost, recorded once for the sample that finalizes each pixel.
+// 'time' works in any build; the counter modes read the stats.h counters and
+// need RT_STATS=1.
+enum heatmap_mode {
+  heatmap_off,
+  heatmap_time,
+  heatmap_bvh_nodes,
+  heatmap_primitive_tests
+};
+
+heatmap_mode parse_heatmap_mode(const std::string& name) {
+  if (name == "time") return heatmap_time;
+  if (name == "bvh_nodes") return heatmap_bvh_nodes;
+  if (name == "primitive_tests") return heatmap_primitive_tests;
+  return heatmap_off;
+}
+
+// Measures one pixel: construct before sampling, read cost() after.
+struct cost_probe {
+  explicit cost_probe(heatmap_mode m) : mode(m) {
+    if (mode == heatmap_time) start_time = std::chrono::high_resolution_clock::now();
+    else if (mode == heatmap_bvh_nodes) start_count = thread_stats().bvh_nodes_visited;
+    else if (mode == heatmap_primitive_tests) start_count = thread_stats().primitive_tests;
+  }
+
+  // Microseconds, or the number of counted events
+  float cost() const {
+    switch (mode) {
+      case heatmap_time:
+        return float(std::chrono::duration<double, std::micro>(std::chrono::high_resolution_clock::now() - start_time).count());
+      case heatmap_bvh_nodes: return float(thread_stats().bvh_nodes_visited - start_count);
+      case heatmap_primitive_tests: return float(thread_stats().primitive_tests - start_count);
+      default: return 0.0f;
+    }
+  }
+
+  heatmap_mode mode;
+  std::chrono::high_resolution_clock::time_point start_time;
+  uint64_t start_count = 0;
+};
+
+// Piecewise linear approximation of the 'inferno' colormap, t in [0,1]
+void heat_color(float t, uint8_t* rgb) {
+  static const float stops[6][3] = {
+    { 0.00f, 0.00f, 0.02f },
+    { 0.26f, 0.04f, 0.41f },
+    { 0.58f, 0.15f, 0.40f },
+    { 0.87f, 0.32f, 0.23f },
+    { 0.99f, 0.65f, 0.04f },
+    { 0.99f, 1.00f, 0.64f }
+  };
+  t = t < 0.0f ? 0.0f : (t > 1.0f ? 1.0f : t);
+  float x = t * 5.0f;
+  int i = int(x) < 4 ? int(x) : 4;
+  float f = x - float(i);
+  for (int c = 0; c < 3; ++c)
+    rgb[c] = uint8_t((stops[i][c] + (stops[i + 1][c] - stops[i][c]) * f) * 255.99f);
+}
+
+// Writes the false color PNG and the raw costs as <base>.png and <base>.pfm.
+// Colors are scaled to the 99th percentile so a handful of extreme pixels
+// don't flatten the rest of the map.
+void write_heatmap(const char* base, const float* cost, int width, int height) {
+  size_t n = size_t(width) * height;
+  std::vector<float> sorted(cost, cost + n);
+  size_t k = n * 99 / 100;
+  std::nth_element(sorted.begin(), sorted.begin() + k, sorted.end());
+  float scale = sorted[k] > 0.0f ? 1.0f / sorted[k] : 1.0f;
+
+  std::vector<uint8_t> rgb(3 * n);
+  for (size_t i = 0; i < n; ++i) heat_color(cost[i] * scale, &rgb[3 * i]);
+
+  std::string path(base);
+  stbi_write_png((path + ".png").c_str(), width, height, 3, rgb.data(), 3 * width);
+  write_pfm((path + ".pfm").c_str(), cost, width, height, 1);
+}
+
+#endif
@@ -0,0 +1,177 @@
+/* Author: Diego Cosin <cosinma@esat-alumni.com>. */
+#ifndef __INSTANCE_H__
+#define __INSTANCE_H__ 1
+
+#include <float.h>
+#include "hittable.h"
+
+// Affine transform stored as the top three rows of a 4x4 matrix. Each row is
+// a vec4 (m0 m1 m2 t) so a transformed component is a single dot().
+class affine {
+ public:
+  affine() {
+    row[0] = vec4(1, 0, 0, 0);
+    row[1] = vec4(0, 1, 0, 0);
+    row[2] = vec4(0, 0, 1, 0);
+  }
+  affine(const vec4& r0, const vec4& r1, const vec4& r2) {
+    row[0] = r0;
+    row[1] = r1;
+    row[2] = r2;
+  }
+
+  vec4 point(const vec4& p) const {
+    vec4 h(p.x, p.y, p.z, 1.0);
+    return vec4(dot(row[0], h), dot(row[1], h), dot(row[2], h));
+  }
+  vec4 vector(const vec4& v) const {
+    vec4 h(_mm256_blend_pd(v._register, _mm256_setzero_pd(), 0x8));
+    return vec4(dot(row[0], h), dot(row[1], h), dot(row[2], h));
+  }
+
+  affine inverse() const;
+  affine normal_matrix() const;
+
+  static affine translation(const vec4& offset);
+  static affine rotation_y(double degrees);
+  static affine scaling(const vec4& factors);
+
+  vec4 row[3];
+};
+
+affine operator*(const affine& a, const affine& b) {
+  affine m;
+  for (int i = 0; i < 3; ++i) {
+    for (int j = 0; j < 4; ++j) {
+      m.row[i][j] = a.row[i][0] * b.row[0][j] + a.row[i][1] * b.row[1][j] + a.row[i][2] * b.row[2][j];
+    }
+    m.row[i][3] += a.row[i][3];
+  }
+  return m;
+}
+
+affine affine::inverse() const {
+  const vec4& a = row[0];
+  const vec4& b = row[1];
+  const vec4& c = row[2];
+  double det = a.x * (b.y * c.z - b.z * c.y)
+             - a.y * (b.x * c.z - b.z * c.x)
+             + a.z * (b.x * c.y - b.y * c.x);
+  double inv_det = 1.0 / det;
+  affine m(
+    vec4((b.y * c.z - b.z * c.y), -(a.y * c.z - a.z * c.y),  (a.y * b.z - a.z * b.y)) * inv_det,
+    vec4(-(b.x * c.z - b.z * c.x), (a.x * c.z - a.z * c.x), -(a.x * b.z - a.z * b.x)) * inv_det,
+    vec4((b.x * c.y - b.y * c.x), -(a.x * c.y - a.y * c.x),  (a.x * b.y - a.y * b.x)) * inv_det);
+  vec4 t(a.w, b.w, c.w);
+  vec4 it = -m.vector(t);
+  m.row[0][3] = it.x;
+  m.row[1][3] = it.y;
+  m.row[2][3] = it.z;
+  return m;
+}
+
+// Transpose of the inverse linear part, which carries normals to world space.
+affine affine::normal_matrix() const {
+  affine inv = inverse();
+  return affine(vec4(inv.row[0].x, inv.row[1].x, inv.row[2].x),
+                vec4(inv.row[0].y, inv.row[1].y, inv.row[2].y),
+                vec4(inv.row[0].z, inv.row[1].z, inv.row[2].z));
+}
+
+affine affine::translation(const vec4& offset) {
+  return affine(vec4(1, 0, 0, offset.x),
+                vec4(0, 1, 0, offset.y),
+                vec4(0, 0, 1, offset.z));
+}
+
+affine affine::rotation_y(double degrees) {
+  double radians = (static_cast<double>(M_PI) / 180.0) * degrees;
+  double s = sin(radians);
+  double c = cos(radians);
+  return affine(vec4( c, 0, s),
+                vec4( 0, 1, 0),
+                vec4(-s, 0, c));
+}
+
+affine affine::scaling(const vec4& factors) {
+  return affine(vec4(factors.x, 0, 0),
+                vec4(0, factors.y, 0),
+                vec4(0, 0, factors.z));
+}
+
+// Places shared geometry in the world through an affine transform. The
+// referenced hittable is the instance's bottom-level structure (usually a
+// bvh_node over the mesh) and is never copied, so any number of instances
+// cost one mesh plus ~350 bytes each. A bvh_node built over instances is the
+// top level of a two-level BVH.
+class instance : public hittable {
+ public:
+  instance(hittable *p, const affine& to_world);
+  virtual bool hit(const ray& r, double t_min, double t_max, hit_record& rec) const;
+  virtual bool bounding_box(double t0, double t1, aabb& box) const {
+    box = bbox; return hasbox;
+  }
+  // Exact for rigid transforms; scaling changes the solid angle.
+  virtual double pdf_value(const vec4& o, const vec4& v) const {
+    return ptr->pdf_value(world_to_object.point(o), world_to_object.vector(v));
+  }
+  virtual vec4 random(const vec4& o) const {
+    return object_to_world.vector(ptr->random(world_to_object.point(o)));
+  }
+  void set_transform(const affine& to_world);
+
+  hittable *ptr;
+  affine object_to_world;
+  affine world_to_object;
+  affine normal_to_world;
+  bool hasbox;
+  aabb bbox;
+};
+
+instance::instance(hittable *p, const affine& to_world) : ptr(p) {
+  kind = hk_instance;
+  set_transform(to_world);
+}
+
+void instance::set_transform(const affine& to_world) {
+  object_to_world = to_world;
+  world_to_object = to_world.inverse();
+  normal_to_world = to_world.normal_matrix();
+
+  aabb local;
+  hasbox = ptr->bounding_box(0, 1, local);
+  if (!hasbox)
+    return;
+  vec4 min(DBL_MAX, DBL_MAX, DBL_MAX);
+  vec4 max(-DBL_MAX, -DBL_MAX, -DBL_MAX);
+  for (int i = 0; i < 2; i++) {
+    for (int j = 0; j < 2; j++) {
+      for (int k = 0; k < 2; k++) {
+        vec4 corner(i ? local.max().x : local.min().x,
+                    j ? local.max().y : local.min().y,
+                    k ? local.max().z : local.min().z);
+        vec4 tester = object_to_world.point(corner);
+        for (int c = 0; c < 3; c++) {
+          min[c] = ffmin(min[c], tester[c]);
+          max[c] = ffmax(max[c], tester[c]);
+        }
+      }
+    }
+  }
+  bbox = aabb(min, max);
+}
+
+bool instance::hit(const ray& r, double t_min, double t_max, hit_record& rec) const {
+  // An affine map keeps the ray parameter, so t needs no conversion.
+  ray local_r(world_to_object.point(r.origin()), world_to_object.vector(r.direction()), r.time());
+  if (dispatch_hit(ptr, local_r, t_min, t_max, rec)) {
+    rec.p = object_to_world.point(rec.p);
+    rec.normal = normal_to_world.vector(rec.normal).normalized();
+    rec.object_id = object_id;
+    return true;
+  }
+  else
+    return false;
+}
+
+#endif
@@ -0,0 +1,280 @@
+/* Author: Diego Cosin <cosinma@esat-alumni.com>. */
+#ifndef __INTEGRATOR_H__
+#define __INTEGRATOR_H__ 1
+
+#include <stdint.h>
+#include <math.h>
+#include "float.h"
+#include "hittable.h"
+#include "camera.h"
+#include "material.h"
+#include "pdf.h"
+#include "settings.h"
+#include "dispatch.h"
+#include "stats.h"
+
+inline bool valid_sample(const vec4& c) {
+  return isfinite(c.x) && isfinite(c.y) && isfinite(c.z);
+}
+
+inline double luminance(const vec4& c) {
+  return 0.2126*c.x + 0.7152*c.y + 0.0722*c.z;
+}
+
+// Rays traced by the calling thread: 'primary' counts camera rays and
+// 'total' every path segment; 'invalid' counts samples dropped for being
+// NaN or infinite. One thread-local increment per ray, so it stays on in
+// release builds.
+struct ray_counter {
+  uint64_t primary = 0;
+  uint64_t total = 0;
+  uint64_t invalid = 0;
+};
+thread_local ray_counter thread_rays;
+
+// What the first hit of a path looked like, for the denoiser and the AOVs.
+// Misses get the background as albedo, a zero normal, zero depth and object
+// id 0.
+struct sample_features {
+  vec4 albedo;
+  vec4 normal;
+  double depth;
+  int object_id;
+};
+
+// Per-pixel averages of sample_features, plus the variance of the pixel's
+// mean luminance (linear space) and the number of samples that made it into
+// the average. An id can't be averaged, so 'object_id' is the first valid
+// sample's.
+struct pixel_features {
+  vec4 albedo;
+  vec4 normal;
+  double depth = 0.0;
+  double variance = 0.0;
+  int samples = 0;
+  int object_id = 0;
+};
+
+vec4 background(const ray& r) {
+  double t = 0.5*((r.direction()).normalized().y + 1.0);
+  return vec4(1.0, 1.0, 1.0)*(1.0-t) + vec4(0.5, 0.7, 1.0)*t;
+  //return vec4(0.0, 0.0, 0.0);
+}
+
+// 'features' is only filled for the camera ray and is never passed down.
+vec4 color(const ray& r, hittable *world, hittable *light, int depth, sample_features *features = nullptr) {
+  thread_rays.total++;
+  hit_record hrec;
+  if (dispatch_hit(world, r, 0.001, DBL_MAX, hrec)) {
+    STAT_INC(hits);
+    if (features != nullptr) {
+      features->albedo = vec4(0.0, 0.0, 0.0);
+      features->normal = hrec.normal;
+      features->depth = hrec.t * r.direction().length();
+      features->object_id = hrec.object_id;
+    }
+    // A zero-length (or NaN) normal can't be shaded, absorb the path
+    if (!(dot(hrec.normal, hrec.normal) > 0.0)) {
+      STAT_BOUNCES(depth);
+      return vec4(0.0, 0.0, 0.0);
+    }
+    scatter_record srec;
+    vec4 emitted = dispatch_emitted(hrec.mat_ptr, r, hrec, hrec.u, hrec.v, hrec.p);
+
+    // Depth per ray
+    if (depth < 3 && dispatch_scatter(hrec.mat_ptr, r, hrec, srec)) {
+      if (features != nullptr) features->albedo = srec.attenuation;
+      if (srec.is_specular) {
+        STAT_INC(rays_specular);
+        return srec.attenuation * color(srec.specular_ray, world, light, depth+1);
+      }
+      else {
+        hittable_pdf plight(light, hrec.p);
+        mixture_pdf p(&plight, srec.pdf_ptr);
+        ray scattered = ray(hrec.p, p.generate(), r.time());
+        double pdf_val = p.value(scattered.direction());
+        delete srec.pdf_ptr;
+        // A direction the mixture can't produce carries no estimate
+        if (!(pdf_val > 0.0) || !isfinite(pdf_val)) {
+          STAT_BOUNCES(depth);
+          return emitted;
+        }
+        STAT_INC(rays_diffuse);
+        return emitted + srec.attenuation * dispatch_scattering_pdf(hrec.mat_ptr, r, hrec, scattered) * color(scattered, world, light, depth+1) / pdf_val;
+      }
+    }
+    else {
+        // Lights keep their hue with the brightness taken out
+        if (features != nullptr) {
+          double peak = ffmax(emitted.x, ffmax(emitted.y, emitted.z));
+          features->albedo = peak > 1.0 ? emitted / peak : emitted;
+        }
+        STAT_BOUNCES(depth);
+        return emitted;
+    }
+  }
+  else {
+    STAT_BOUNCES(depth);
+    vec4 sky = background(r);
+    if (features != nullptr) {
+      features->albedo = sky;
+      features->normal = vec4(0.0, 0.0, 0.0);
+      features->depth = 0.0;
+      features->object_id = 0;
+    }
+    return sky;
+  }
+}
+
+// One path through a random point of pixel (px, py), scaled down to
+// s->max_sample_luminance when that is positive. False for a non-finite
+// sample, which is counted and has to be left out.
+inline bool camera_sample(camera *view, hittable *world, hittable *light, int px, int py, const settings* s, sample_features *first, vec4& c) {
+  double inv_width = 1.0 / double(s->window_width);
+  double inv_height = 1.0 / double(s->window_height);
+  double u = double(px + random_double()) * inv_width;
+  double v = double(s->window_height - py + random_double()) * inv_height;
+
+  thread_rays.primary++;
+  c = color(view->get_ray(u, v), world, light, 0, first);
+  if (!valid_sample(c)) {
+    thread_rays.invalid++;
+    STAT_INC(invalid_samples);
+    return false;
+  }
+  if (s->max_sample_luminance > 0.0) {
+    double y = luminance(c);
+    if (y > s->max_sample_luminance)
+      c *= s->max_sample_luminance / y;
+  }
+  return true;
+}
+
+// Running sums of the camera ray features of one pixel's valid samples,
+// resolved into the averages of pixel_features
+struct feature_sums {
+  vec4 albedo, normal;
+  double depth = 0.0, luminance_sum = 0.0, luminance_sq_sum = 0.0;
+  int valid = 0;
+  int object_id = 0;
+
+  void add(const sample_features& first, const vec4& c) {
+    if (++valid == 1) object_id = first.object_id;
+    albedo += first.albedo;
+    normal += first.normal;
+    depth += first.depth;
+    double y = luminance(c);
+    luminance_sum += y;
+    luminance_sq_sum += y * y;
+  }
+
+  void resolve(pixel_features *features) const {
+    double n = valid > 0 ? double(valid) : 1.0;
+    features->albedo = albedo / n;
+    double length = normal.length();
+    features->normal = length > 0.0 ? normal / length : vec4(0.0, 0.0, 0.0);
+    features->depth = depth / n;
+    double mean = luminance_sum / n;
+    features->variance = ffmax(0.0, luminance_sq_sum / n - mean * mean) / n;
+    features->samples = valid;
+    features->object_id = object_id;
+  }
+};
+
+// Averages s->num_samples paths through pixel (px, py), counted from the top
+// left corner, and returns the gamma corrected color. Every sample costs
+// exactly one path: a non-finite one is counted and left out of the average
+// rather than traced again. When s->max_sample_luminance is positive,
+// brighter samples are scaled down to it, which trades a little bias for
+// no fireflies. 'features', when given, receives the denoiser inputs.
+vec4 sample_pixel(camera *view, hittable *world, hittable *light, int px, int py, settings* s, pixel_features *features = nullptr) {
+  STAT_TIMER(stage_render);
+  vec4 col = vec4(0.0, 0.0, 0.0);
+  int valid = 0;
+  sample_features first;
+  feature_sums sums;
+  for (int samples = 0; samples < s->num_samples; samples++) {
+    vec4 c;
+    if (!camera_sample(view, world, light, px, py, s, features != nullptr ? &first : nullptr, c)) continue;
+    col += c;
+    valid++;
+    if (features != nullptr) sums.add(first, c);
+  }
+
+  if (valid > 0)
+    col /= double(valid);
+  if (features != nullptr) sums.resolve(features);
+  return col.square_root();
+}
+
+// Sample splitting (see render_batch.cc). Samples are drawn in blocks of
+// kSampleBlock, each block from a generator seeded by the pixel and block
+// index, and summed in fixed point, where addition is exact. Renders of
+// disjoint sample ranges therefore add up, in any order, to exactly what a
+// single render of all of them gives. Reseeding the mt19937 costs about as
+// much as a few paths, hence the blocks.
+const int kSampleBlock = 64;
+// Fixed point units per unit of radiance
+const double kAccumScale = 4294967296.0;
+// Every sample is clamped to this, so sums stay exact up to 2^11 samples at
+// the clamp
+const double kAccumMaxSample = 1048576.0;
+// Each clamped sample adds 2^52 units to an int64 sum; 2^11 of them would
+// overflow it. Renders that accumulate refuse more samples per pixel.
+const int kAccumMaxSamples = 2047;
+
+struct pixel_accum {
+  int64_t sum[3];     // Radiance, in units of 1 / kAccumScale
+  uint32_t samples;   // Valid samples in the sums
+  uint32_t padding;
+};
+
+inline uint32_t sample_block_seed(uint32_t seed, uint32_t pixel, uint32_t block) {
+  // splitmix64 finalizer
+  uint64_t h = ((uint64_t(seed) << 32) | pixel) ^ (uint64_t(block) * 0x9e3779b97f4a7c15ull);
+  h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ull;
+  h = (h ^ (h >> 27)) * 0x94d049bb133111ebull;
+  return uint32_t((h ^ (h >> 31)) >> 32);
+}
+
+inline int64_t to_fixed(double v) {
+  return int64_t(ffmin(ffmax(v, 0.0), kAccumMaxSample) * kAccumScale + 0.5);
+}
+
+// Adds samples [first, first + count) of pixel (px, py) to 'acc'. 'first'
+// has to start a block. 'features', when given, receives the denoiser inputs
+// of these samples alone.
+void accumulate_pixel(camera *view, hittable *world, hittable *light, int px, int py, settings* s,
+                      uint32_t seed, int first, int count, pixel_accum& acc, pixel_features *features = nullptr) {
+  STAT_TIMER(stage_render);
+  uint32_t pixel = uint32_t(py) * uint32_t(s->window_width) + uint32_t(px);
+  sample_features camera_features;
+  feature_sums sums;
+  for (int i = first; i < first + count; ++i) {
+    if (i % kSampleBlock == 0) seed_random(sample_block_seed(seed, pixel, uint32_t(i / kSampleBlock)));
+    vec4 c;
+    if (!camera_sample(view, world, light, px, py, s, features != nullptr ? &camera_features : nullptr, c)) continue;
+    acc.sum[0] += to_fixed(c.x);
+    acc.sum[1] += to_fixed(c.y);
+    acc.sum[2] += to_fixed(c.z);
+    acc.samples++;
+    if (features != nullptr) sums.add(camera_features, c);
+  }
+  if (features != nullptr) sums.resolve(features);
+}
+
+inline void merge_accum(pixel_accum& into, const pixel_accum& from) {
+  into.sum[0] += from.sum[0];
+  into.sum[1] += from.sum[1];
+  into.sum[2] += from.sum[2];
+  into.samples += from.samples;
+}
+
+// The linear mean of the accumulated samples
+inline vec4 resolve_accum(const pixel_accum& acc) {
+  if (acc.samples == 0) return vec4(0.0, 0.0, 0.0);
+  double scale = 1.0 / (kAccumScale * double(acc.samples));
+  return vec4(double(acc.sum[0]) * scale, double(acc.sum[1]) * scale, double(acc.sum[2]) * scale);
+}
+
+#endif
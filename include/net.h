@@ -0,0 +1,184 @@
+/* Author: Diego Cosin <cosinma@esat-alumni.com>. */
+#ifndef __NET_H__
+#define __NET_H__ 1
+
+// Blocking TCP over BSD sockets or Winsock, just enough for the render farm
+// protocol in render_batch.cc: messages are a type and a byte count followed
+// by the payload, in host byte order (every node is the same build).
+//
+// On Windows this has to come before anything that includes <windows.h>.
+
+#include <stdint.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#pragma comment(lib, "ws2_32.lib")
+typedef SOCKET net_socket;
+const net_socket kNoSocket = INVALID_SOCKET;
+#else
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/select.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <netdb.h>
+#include <unistd.h>
+#include <signal.h>
+typedef int net_socket;
+const net_socket kNoSocket = -1;
+#endif
+
+bool net_init() {
+#ifdef _WIN32
+  WSADATA data;
+  return WSAStartup(MAKEWORD(2, 2), &data) == 0;
+#else
+#if !defined(MSG_NOSIGNAL) && !defined(SO_NOSIGPIPE)
+  // Nothing else stops a dead peer from killing the process
+  signal(SIGPIPE, SIG_IGN);
+#endif
+  return true;
+#endif
+}
+
+void net_close(net_socket s) {
+  if (s == kNoSocket) return;
+#ifdef _WIN32
+  closesocket(s);
+#else
+  close(s);
+#endif
+}
+
+// Results are sent as soon as they are written, don't wait to batch them.
+// A send to a dead peer is an error, not SIGPIPE: MSG_NOSIGNAL covers Linux,
+// SO_NOSIGPIPE macOS and the BSDs.
+void net_no_delay(net_socket s) {
+  int on = 1;
+  setsockopt(s, IPPROTO_TCP, TCP_NODELAY, (const char*)&on, sizeof(on));
+#ifdef SO_NOSIGPIPE
+  setsockopt(s, SOL_SOCKET, SO_NOSIGPIPE, (const char*)&on, sizeof(on));
+#endif
+}
+
+// Sends and receives on 's' fail once they make no progress for 'seconds',
+// so a peer that hangs without disconnecting is noticed too
+void net_set_timeout(net_socket s, int seconds) {
+#ifdef _WIN32
+  DWORD tv = DWORD(seconds) * 1000;
+#else
+  timeval tv;
+  tv.tv_sec = seconds;
+  tv.tv_usec = 0;
+#endif
+  setsockopt(s, SOL_SOCKET, SO_RCVTIMEO, (const char*)&tv, sizeof(tv));
+  setsockopt(s, SOL_SOCKET, SO_SNDTIMEO, (const char*)&tv, sizeof(tv));
+}
+
+net_socket net_listen(int port) {
+  net_socket s = socket(AF_INET, SOCK_STREAM, 0);
+  if (s == kNoSocket) return kNoSocket;
+  int on = 1;
+  setsockopt(s, SOL_SOCKET, SO_REUSEADDR, (const char*)&on, sizeof(on));
+  sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_ANY);
+  addr.sin_port = htons(uint16_t(port));
+  if (bind(s, (sockaddr*)&addr, sizeof(addr)) != 0 || listen(s, 64) != 0) {
+    net_close(s);
+    return kNoSocket;
+  }
+  return s;
+}
+
+// Waits up to 'timeout_ms' for a connection, kNoSocket if none came
+net_socket net_accept(net_socket listener, int timeout_ms) {
+  fd_set ready;
+  FD_ZERO(&ready);
+  FD_SET(listener, &ready);
+  timeval tv;
+  tv.tv_sec = timeout_ms / 1000;
+  tv.tv_usec = (timeout_ms % 1000) * 1000;
+  if (select(int(listener + 1), &ready, nullptr, nullptr, &tv) <= 0) return kNoSocket;
+  net_socket s = accept(listener, nullptr, nullptr);
+  if (s != kNoSocket) net_no_delay(s);
+  return s;
+}
+
+// 'address' is host:port
+net_socket net_connect(const std::string& address) {
+  size_t colon = address.rfind(':');
+  if (colon == std::string::npos) return kNoSocket;
+  std::string host = address.substr(0, colon), port = address.substr(colon + 1);
+  addrinfo hints;
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_INET;
+  hints.ai_socktype = SOCK_STREAM;
+  addrinfo* found = nullptr;
+  if (getaddrinfo(host.c_str(), port.c_str(), &hints, &found) != 0) return kNoSocket;
+  net_socket s = kNoSocket;
+  for (addrinfo* a = found; a != nullptr && s == kNoSocket; a = a->ai_next) {
+    s = socket(a->ai_family, a->ai_socktype, a->ai_protocol);
+    if (s != kNoSocket && connect(s, a->ai_addr, int(a->ai_addrlen)) != 0) {
+      net_close(s);
+      s = kNoSocket;
+    }
+  }
+  freeaddrinfo(found);
+  if (s != kNoSocket) net_no_delay(s);
+  return s;
+}
+
+bool net_send_all(net_socket s, const void* data, size_t size) {
+  const char* p = static_cast<const char*>(data);
+#ifdef MSG_NOSIGNAL
+  const int flags = MSG_NOSIGNAL;  // See net_no_delay
+#else
+  const int flags = 0;
+#endif
+  while (size > 0) {
+    int sent = int(send(s, p, int(size > (1 << 30) ? (1 << 30) : size), flags));
+    if (sent <= 0) return false;
+    p += sent;
+    size -= size_t(sent);
+  }
+  return true;
+}
+
+bool net_recv_all(net_socket s, void* data, size_t size) {
+  char* p = static_cast<char*>(data);
+  while (size > 0) {
+    int got = int(recv(s, p, int(size > (1 << 30) ? (1 << 30) : size), 0));
+    if (got <= 0) return false;
+    p += got;
+    size -= size_t(got);
+  }
+  return true;
+}
+
+struct net_message {
+  uint32_t type;
+  std::vector<uint8_t> payload;
+};
+
+bool net_send(net_socket s, uint32_t type, const void* payload, uint32_t size) {
+  uint32_t head[2] = { type, size };
+  return net_send_all(s, head, sizeof(head)) && (size == 0 || net_send_all(s, payload, size));
+}
+
+// Payloads over 'max_size' mean a confused peer and fail the read
+bool net_recv(net_socket s, net_message& m, uint32_t max_size = 1u << 30) {
+  uint32_t head[2];
+  if (!net_recv_all(s, head, sizeof(head)) || head[1] > max_size) return false;
+  m.type = head[0];
+  m.payload.resize(head[1]);
+  return head[1] == 0 || net_recv_all(s, m.payload.data(), head[1]);
+}
+
+#endif
@@ -0,0 +1,105 @@
+/* Author: Diego Cosin <cosinma@esat-alumni.com>. */
+#ifndef __NUMA_H__
+#define __NUMA_H__ 1
+
+// NUMA placement of the scene. A scene built by the main thread lives in the
+// memory of the main thread's node, and on a multi-socket machine every ray
+// the other nodes trace walks the BVH, primitives and textures remotely.
+// With replication every node gets its own copy of the scene, built by a
+// thread pinned to that node so that first-touch allocation puts all of it
+// in local memory; render threads are pinned to nodes and trace their
+// node's copy. The copies are built one after another from the same seed
+// and with the same object ids, so they are identical and the image does
+// not depend on which copy a pixel was traced in.
+//
+// Frame data is not replicated. In the batch renderer every thread renders
+// into tile buffers it allocates itself, so those are local. The viewer
+// hands runs to whichever worker is free, with no fixed thread for a tile:
+// a framebuffer page lands on the node of the worker that happens to write
+// it first (see new_framebuffer), later passes may write it from another
+// node, and the AOVs, flags and costs are allocated and cleared by the main
+// thread.
+
+#include <stdlib.h>
+#include <thread>
+#include <vector>
+#include "affinity.h"
+#include "scenes.h"
+
+struct scene_instance {
+  hittable *world = nullptr;
+  hittable *light = nullptr;
+  camera *view = nullptr;
+  animation anim;
+
+  // Holds vec4s
+  void* operator new(size_t i) { return _mm_malloc(i, 32); }
+  void operator delete(void* p) { _mm_free(p); }
+};
+
+// The NUMA node render thread 'index' runs on, 0 when it isn't pinned
+int thread_node(int index, affinity_mode mode) {
+  const cpu_topology& t = topology();
+  if (t.nodes.size() < 2) return 0;
+  if (mode == affinity_nodes) return index % int(t.nodes.size());
+  if (mode == affinity_cores) {
+    int cpu = t.cpus[index % t.cpus.size()];
+    for (size_t n = 0; n < t.nodes.size(); ++n)
+      for (size_t i = 0; i < t.nodes[n].size(); ++i)
+        if (t.nodes[n][i] == cpu) return int(n);
+  }
+  return 0;
+}
+
+// How to pin render threads: the affinity setting, or one node per thread
+// when the scene is replicated and nothing else was asked for
+affinity_mode thread_affinity(const settings& s) {
+  affinity_mode mode = parse_affinity_mode(s.affinity);
+  return s.numa && mode == affinity_none ? affinity_nodes : mode;
+}
+
+struct scene_replicas {
+  // One copy per NUMA node, or a single one
+  std::vector<scene_instance*> copies;
+
+  const scene_instance& for_thread(int index, affinity_mode mode) const {
+    return *copies[thread_node(index, mode) % copies.size()];
+  }
+
+  // Animates every copy to time t, see animation::apply
+  bool apply(double t) {
+    bool rebuilt = false;
+    for (size_t i = 0; i < copies.size(); ++i)
+      rebuilt = copies[i]->anim.apply(t, copies[i]->view) || rebuilt;
+    return rebuilt;
+  }
+};
+
+// Builds scene 'scene_index' from 'seed', once per NUMA node when
+// 'replicate' is set and the machine has more than one
+void build_scene_replicas(int scene_index, settings* s, uint32_t seed, bool replicate, scene_replicas& out) {
+  const cpu_topology& t = topology();
+  int count = replicate && t.nodes.size() > 1 ? int(t.nodes.size()) : 1;
+  int first_id = object_id_counter();
+  for (int n = 0; n < count; ++n) {
+    scene_instance* copy = new scene_instance();
+    auto build = [&]() {
+      object_id_counter() = first_id;
+      seed_random(seed);
+      load_scene(scene_index, &copy->world, &copy->light, &copy->view, &copy->anim, s);
+    };
+    if (count == 1) {
+      build();
+    }
+    else {
+      std::thread builder([&]() {
+        pin_current_thread_to(t.nodes[n]);
+        build();
+      });
+      builder.join();
+    }
+    out.copies.push_back(copy);
+  }
+}
+
+#endif
@@ -1,95 +1,115 @@
-/* Author: Diego Cosin <cosinma@esat-alumni.com>. */
-#ifndef __PERLIN_H_
-#define __PERLIN_H_
-
-#include "vec4.h"
-#include "random.h"
-
-inline double perlin_interp(vec4 c[2][2][2], double u, double v, double w) {
-  double uu = u*u*(3-2*u);
-  double vv = v*v*(3-2*v);
-  double ww = w*w*(3-2*w);
-  double accum = 0;
-  for (int i=0; i < 2; i++)
-    for (int j=0; j < 2; j++)
-      for (int k=0; k < 2; k++) {
-        vec4 weight_v(u-i, v-j, w-k);
-        accum += (i*uu + (1-i)*(1-uu))*
-                 (j*vv + (1-j)*(1-vv))*
-                 (k*ww + (1-k)*(1-ww))*
-                 dot(c[i][j][k], weight_v);
-      }
-  return accum;
-}
-
-class perlin {
- public:
-  double noise(const vec4& p) const {
-    double u = p.x - floor(p.x);
-    double v = p.y - floor(p.y);
-    double w = p.z - floor(p.z);
-    int i = static_cast<int>(floor(p.x));
-    int j = static_cast<int>(floor(p.y));
-    int k = static_cast<int>(floor(p.z));
-    vec4 c[2][2][2];
-    for (int di=0; di < 2; di++)
-      for (int dj=0; dj < 2; dj++)
-        for (int dk=0; dk < 2; dk++)
-          c[di][dj][dk] = ranvec[perm_x[(i+di) & 255] ^
-                                 perm_y[(j+dj) & 255] ^
-                                 perm_z[(k+dk) & 255]];
-    return perlin_interp(c, u, v, w);
-  }
-  double turb(const vec4& p, int depth=7) const {
-    double accum = 0;
-    vec4 temp_p = p;
-    double weight = 1.0;
-    for (int i = 0; i < depth; i++) {
-      accum += weight*noise(temp_p);
-      weight *= 0.5;
-      temp_p *= 2;
-    }
-    return fabs(accum);
-  }
-  static vec4 *ranvec;
-  static int *perm_x;
-  static int *perm_y;
-  static int *perm_z;
-};
-
-static vec4* perlin_generate() {
-  vec4 *p = new vec4[256];
-  for (int i = 0; i < 256; ++i) {
-    double x_random = 2*random_double() - 1;
-    double y_random = 2*random_double() - 1;
-    double z_random = 2*random_double() - 1;
-    p[i] = (vec4(x_random, y_random, z_random)).normalized();
-  }
-  return p;
-}
-
-void permute(int *p, int n) {
-  for (int i = n-1; i > 0; i--) {
-    int target = int(random_double()*(i+1));
-    int tmp = p[i];
-    p[i] = p[target];
-    p[target] = tmp;
-  }
-  return;
-}
-
-static int* perlin_generate_perm() {
-  int * p = new int[256];
-  for (int i = 0; i < 256; i++)
-    p[i] = i;
-  permute(p, 256);
-  return p;
-}
-
-vec4 *perlin::ranvec = perlin_generate();
-int *perlin::perm_x = perlin_generate_perm();
-int *perlin::perm_y = perlin_generate_perm();
-int *perlin::perm_z = perlin_generate_perm();
-
-
-#endif
+/* Author: Diego Cosin <cosinma@esat-alumni.com>. */
+#ifndef __PERLIN_H_
+#define __PERLIN_H_
+
+#include <random>
+#include "vec4.h"
+#include "random.h"
+
+inline double perlin_interp(vec4 c[2][2][2], double u, double v, double w) {
+  double uu = u*u*(3-2*u);
+  double vv = v*v*(3-2*v);
+  double ww = w*w*(3-2*w);
+  double accum = 0;
+  for (int i=0; i < 2; i++)
+    for (int j=0; j < 2; j++)
+      for (int k=0; k < 2; k++) {
+        vec4 weight_v(u-i, v-j, w-k);
+        accum += (i*uu + (1-i)*(1-uu))*
+                 (j*vv + (1-j)*(1-vv))*
+                 (k*ww + (1-k)*(1-ww))*
+                 dot(c[i][j][k], weight_v);
+      }
+  return accum;
+}
+
+static vec4* perlin_generate(std::mt19937& generator);
+static int* perlin_generate_perm(std::mt19937& generator);
+
+// Every perlin makes the same tables, from the default mt19937 seed, but
+// in memory of its own: a scene built once per NUMA node (numa.h) gets
+// them on that node.
+class perlin {
+ public:
+  perlin() {
+    std::mt19937 generator;
+    ranvec = perlin_generate(generator);
+    perm_x = perlin_generate_perm(generator);
+    perm_y = perlin_generate_perm(generator);
+    perm_z = perlin_generate_perm(generator);
+  }
+  ~perlin() {
+    delete[] ranvec;
+    delete[] perm_x;
+    delete[] perm_y;
+    delete[] perm_z;
+  }
+  perlin(const perlin&) = delete;
+  perlin& operator=(const perlin&) = delete;
+
+  double noise(const vec4& p) const {
+    double u = p.x - floor(p.x);
+    double v = p.y - floor(p.y);
+    double w = p.z - floor(p.z);
+    int i = static_cast<int>(floor(p.x));
+    int j = static_cast<int>(floor(p.y));
+    int k = static_cast<int>(floor(p.z));
+    vec4 c[2][2][2];
+    for (int di=0; di < 2; di++)
+      for (int dj=0; dj < 2; dj++)
+        for (int dk=0; dk < 2; dk++)
+          c[di][dj][dk] = ranvec[perm_x[(i+di) & 255] ^
+                                 perm_y[(j+dj) & 255] ^
+                                 perm_z[(k+dk) & 255]];
+    return perlin_interp(c, u, v, w);
+  }
+  double turb(const vec4& p, int depth=7) const {
+    double accum = 0;
+    vec4 temp_p = p;
+    double weight = 1.0;
+    for (int i = 0; i < depth; i++) {
+      accum += weight*noise(temp_p);
+      weight *= 0.5;
+      temp_p *= 2;
+    }
+    return fabs(accum);
+  }
+  vec4 *ranvec;
+  int *perm_x;
+  int *perm_y;
+  int *perm_z;
+};
+
+static vec4* perlin_generate(std::mt19937& generator) {
+  std::uniform_real_distribution<double> random(0.0, 1.0);
+  vec4 *p = new vec4[256];
+  for (int i = 0; i < 256; ++i) {
+    double x_random = 2*random(generator) - 1;
+    double y_random = 2*random(generator) - 1;
+    double z_random = 2*random(generator) - 1;
+    p[i] = (vec4(x_random, y_random, z_random)).normalized();
+  }
+  return p;
+}
+
+void permute(int *p, int n, std::mt19937& generator) {
+  std::uniform_real_distribution<double> random(0.0, 1.0);
+  for (int i = n-1; i > 0; i--) {
+    int target = int(random(generator)*(i+1));
+    int tmp = p[i];
+    p[i] = p[target];
+    p[target] = tmp;
+  }
+  return;
+}
+
+static int* perlin_generate_perm(std::mt19937& generator) {
+  int * p = new int[256];
+  for (int i = 0; i < 256; i++)
+    p[i] = i;
+  permute(p, 256, generator);
+  return p;
+}
+
+
+#endif
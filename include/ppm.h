@@ -1,72 +1,118 @@
-#include <string>
-#include <iostream>
-#include <fstream>
-#include <sstream>
-
-#ifndef __PPM_H__
-#define __PPM_H__
-
-class ppm {
- public:
-  void init();
-
-  uint16_t height;
-  uint16_t width;
-  uint16_t max_col_val;
-  uint8_t *pix;
-
-  ppm();
-  ppm(const char* fname);
-  void read(const char* fname);
-};
-
-void ppm::init() {
-  width = 0;
-  height = 0;
-  max_col_val = 255;
-}
-ppm::ppm() {
-  init();
-}
-ppm::ppm(const char* fname) {
-  init();
-  read(fname);
-}
-void ppm::read(const char* fname) {
-  std::ifstream file(fname, std::ios::in | std::ios::binary);
-  if (file.is_open()) {
-
-    std::string line;
-
-    std::getline(file, line);
-    if (line != "P6")
-      return;
-
-    do {
-      std::getline(file, line);
-    } while (line[0] == '#');
-
-    std::stringstream dimensions(line);
-
-    dimensions >> width;
-    dimensions >> height;
-
-    std::getline(file, line);
-
-    std::stringstream max_val(line);
-
-    max_val >> max_col_val;
-
-    pix = (uint8_t*) malloc(3*width*height);
-    char aux;
-    for (int i = 0; i < 3*width*height; ++i) {
-      file.read(&aux, 1);
-      pix[i] = (uint8_t) aux;
-    }
-  } else {
-    std::cout << "ERROR: File not found. " << fname << std::endl;
-  }
-  file.close();
-}
-
-#endif
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <utility>
+
+#ifndef __PPM_H__
+#define __PPM_H__
+
+class ppm {
+ public:
+  void init();
+
+  uint16_t height;
+  uint16_t width;
+  uint16_t max_col_val;
+  uint8_t *pix;
+
+  ppm();
+  ppm(const char* fname);
+  void read(const char* fname);
+};
+
+void ppm::init() {
+  width = 0;
+  height = 0;
+  max_col_val = 255;
+}
+ppm::ppm() {
+  init();
+}
+ppm::ppm(const char* fname) {
+  init();
+  read(fname);
+}
+void ppm::read(const char* fname) {
+  std::ifstream file(fname, std::ios::in | std::ios::binary);
+  if (file.is_open()) {
+
+    std::string line;
+
+    std::getline(file, line);
+    if (line != "P6")
+      return;
+
+    do {
+      std::getline(file, line);
+    } while (line[0] == '#');
+
+    std::stringstream dimensions(line);
+
+    dimensions >> width;
+    dimensions >> height;
+
+    std::getline(file, line);
+
+    std::stringstream max_val(line);
+
+    max_val >> max_col_val;
+
+    pix = (uint8_t*) malloc(3*width*height);
+    char aux;
+    for (int i = 0; i < 3*width*height; ++i) {
+      file.read(&aux, 1);
+      pix[i] = (uint8_t) aux;
+    }
+  } else {
+    std::cout << "ERROR: File not found. " << fname << std::endl;
+  }
+  file.close();
+}
+
+// Float map with one ("Pf") or three ("PF") channels. 'data' holds rows from
+// the top; the file stores them bottom row first as the format requires.
+bool write_pfm(const char* path, const float* data, int width, int height, int components) {
+  FILE* f = fopen(path, "wb");
+  if (f == nullptr) return false;
+  fprintf(f, "%s\n%d %d\n-1.0\n", components == 3 ? "PF" : "Pf", width, height);
+  for (int y = height - 1; y >= 0; --y)
+    fwrite(data + size_t(width) * components * y, sizeof(float), size_t(width) * components, f);
+  bool ok = ferror(f) == 0;
+  return fclose(f) == 0 && ok;
+}
+
+// Reads a PFM of either byte order into rows from the top, like write_pfm
+// takes them.
+bool read_pfm(const char* path, std::vector<float>& data, int& width, int& height, int& components) {
+  FILE* f = fopen(path, "rb");
+  if (f == nullptr) return false;
+  char type[3] = { 0, 0, 0 };
+  double scale = 0.0;
+  bool ok = fscanf(f, "%2s %d %d %lf", type, &width, &height, &scale) == 4 && fgetc(f) != EOF &&
+            (strcmp(type, "PF") == 0 || strcmp(type, "Pf") == 0) && width > 0 && height > 0 && scale != 0.0;
+  if (ok) {
+    components = type[1] == 'F' ? 3 : 1;
+    size_t row = size_t(width) * components;
+    data.resize(row * height);
+    for (int y = height - 1; y >= 0 && ok; --y)
+      ok = fread(&data[row * y], sizeof(float), row, f) == row;
+    // A positive scale means big endian
+    uint16_t probe = 1;
+    bool little = *reinterpret_cast<uint8_t*>(&probe) == 1;
+    if (ok && (scale > 0.0) == little) {
+      for (size_t i = 0; i < data.size(); ++i) {
+        uint8_t* b = reinterpret_cast<uint8_t*>(&data[i]);
+        std::swap(b[0], b[3]);
+        std::swap(b[1], b[2]);
+      }
+    }
+  }
+  fclose(f);
+  return ok;
+}
+
+#endif
@@ -1,62 +1,81 @@
-/* Author: Diego Cosin <cosinma@esat-alumni.com>. */
-#ifndef __RANDOM_H__
-#define __RANDOM_H__ 1
-
-#include <functional>
-#include <random>
-// #include <cstdlib>
-
-// Using rand() seems to break multithreaded rendering
-
-inline double random_double() {
-  // return static_cast<double>(rand() / (RAND_MAX + 1.0));
-  static std::uniform_real_distribution<double> distribution(0.0, 1.0);
-  static std::mt19937 generator;
-  static std::function<double()> rand_generator = std::bind(distribution, generator);
-  return rand_generator();
-}
-
-inline vec4 random_cosine_direction() {
-  double r1 = random_double();
-  double r2 = random_double();
-  double z = sqrt(1-r2);
-  double phi = 2*double(M_PI)*r1;
-  double x = cos(phi)*sqrt(r2);
-  double y = sin(phi)*sqrt(r2);
-  return vec4(x, y, z);
-}
-
-inline vec4 random_to_sphere(double radius, double distance_squared) {
-  double r1 = random_double();
-  double r2 = random_double();
-  double z = 1 + r2*(sqrt(1-radius*radius/distance_squared) - 1);
-  double phi = 2*double(M_PI)*r1;
-  double x = cos(phi)*sqrt(1-z*z);
-  double y = sin(phi)*sqrt(1-z*z);
-  return vec4(x, y, z);
-}
-
-vec4 random_in_unit_disk() {
-  vec4 p;
-  do {
-    p = vec4(random_double(),random_double(),0.0)*2.0 - vec4(1,1,0);
-  } while (dot(p,p) >= 1.0);
-  return p;
-}
-
-vec4 random_in_unit_sphere() {
-  vec4 p;
-  do {
-    p = vec4(random_double(), random_double(), random_double())*2.0 - vec4(1,1,1);
-  } while (dot(p,p) >= 1.0);//(p.squared_length() >= 1.0);
-  return p;
-}
-
-vec4 random_on_unit_sphere() {
-    vec4 p;
-    do {
-        p = vec4(random_double(),random_double(),random_double())*2.0 - vec4(1,1,1);
-    } while (dot(p,p) >= 1.0);
-    return p.normalized();
-}
-#endif
+/* Author: Diego Cosin <cosinma@esat-alumni.com>. */
+#ifndef __RANDOM_H__
+#define __RANDOM_H__ 1
+
+#include <stdint.h>
+#include <atomic>
+#include <random>
+#include "vec4.h"
+// #include <cstdlib>
+
+// Using rand() seems to break multithreaded rendering
+
+// Every thread owns its generator, so workers never share state. The n-th
+// thread to draw a number starts from the default mt19937 seed plus n; the
+// main thread (which builds the scenes) gets the default seed itself.
+static std::atomic<uint32_t> random_streams(0);
+
+inline std::mt19937& random_generator() {
+  thread_local std::mt19937 generator(std::mt19937::default_seed + random_streams++);
+  return generator;
+}
+
+// Restarts the calling thread's sequence, for reproducible renders.
+inline void seed_random(uint32_t seed) {
+  random_generator().seed(seed);
+}
+
+inline double random_double() {
+  // return static_cast<double>(rand() / (RAND_MAX + 1.0));
+  thread_local std::uniform_real_distribution<double> distribution(0.0, 1.0);
+  return distribution(random_generator());
+}
+
+inline vec4 random_cosine_direction() {
+  double r1 = random_double();
+  double r2 = random_double();
+  double z = sqrt(1-r2);
+  double phi = 2*double(M_PI)*r1;
+  double x = cos(phi)*sqrt(r2);
+  double y = sin(phi)*sqrt(r2);
+  return vec4(x, y, z);
+}
+
+inline vec4 random_to_sphere(double radius, double distance_squared) {
+  double r1 = random_double();
+  double r2 = random_double();
+  // Clamped so an origin on the surface (distance == radius) gives the
+  // hemisphere instead of a NaN
+  double cos_theta_max = sqrt(fmax(0.0, 1-radius*radius/distance_squared));
+  double z = 1 + r2*(cos_theta_max - 1);
+  double phi = 2*double(M_PI)*r1;
+  double sin_theta = sqrt(fmax(0.0, 1-z*z));
+  double x = cos(phi)*sin_theta;
+  double y = sin(phi)*sin_theta;
+  return vec4(x, y, z);
+}
+
+vec4 random_in_unit_disk() {
+  vec4 p;
+  do {
+    p = vec4(random_double(),random_double(),0.0)*2.0 - vec4(1,1,0);
+  } while (dot(p,p) >= 1.0);
+  return p;
+}
+
+vec4 random_in_unit_sphere() {
+  vec4 p;
+  do {
+    p = vec4(random_double(), random_double(), random_double())*2.0 - vec4(1,1,1);
+  } while (dot(p,p) >= 1.0);//(p.squared_length() >= 1.0);
+  return p;
+}
+
+vec4 random_on_unit_sphere() {
+    vec4 p;
+    do {
+        p = vec4(random_double(),random_double(),random_double())*2.0 - vec4(1,1,1);
+    } while (dot(p,p) >= 1.0);
+    return p.normalized();
+}
+#endif
@@ -1,21 +1,35 @@
-/* Author: Diego Cosin <cosinma@esat-alumni.com>. */
-#ifndef __RAY_H__
-#define __RAY_H__ 1
-
-#include "vec4.h"
-
-class ray {
- public:
-  ray() {}
-  ray(const vec4& a, const vec4& b, double ti = 0.0) { A = a; B = b; _time = ti;}
-  vec4 origin() const                    { return A; }
-  vec4 direction() const                 { return B; }
-  double time() const                     { return _time; }
-  vec4 point_at_parameter(double t) const { return A + B*t; }
-
-  vec4 A;
-  vec4 B;
-  double _time;
-};
-
-#endif
+/* Author: Diego Cosin <cosinma@esat-alumni.com>. */
+#ifndef __RAY_H__
+#define __RAY_H__ 1
+
+#include "vec4.h"
+
+// Besides origin and direction a ray carries the reciprocal of its direction
+// and the sign of each component, computed once here so box tests during
+// traversal are three multiplies and no branches per axis.
+class ray {
+ public:
+  ray() {}
+  ray(const vec4& a, const vec4& b, double ti = 0.0) {
+    A = a;
+    B = b;
+    _time = ti;
+    inv_B = vec4(1.0) / b;
+    sign[0] = inv_B.x < 0.0;
+    sign[1] = inv_B.y < 0.0;
+    sign[2] = inv_B.z < 0.0;
+  }
+  vec4 origin() const                    { return A; }
+  vec4 direction() const                 { return B; }
+  vec4 inv_direction() const             { return inv_B; }
+  double time() const                     { return _time; }
+  vec4 point_at_parameter(double t) const { return A + B*t; }
+
+  vec4 A;
+  vec4 B;
+  vec4 inv_B;
+  int sign[3];
+  double _time;
+};
+
+#endif
@@ -0,0 +1,249 @@
+/* Author: Diego Cosin <cosinma@esat-alumni.com>. */
+#ifndef __SCENES_H__
+#define __SCENES_H__ 1
+
+// Built-in scenes, shared by the viewer and the headless benchmarks. Each
+// builder hands back the world, the light list used for importance sampling,
+// the still camera and the scene's animation.
+
+#include "float.h"
+#include "hittable_list.h"
+#include "sphere.h"
+#include "sphere_set.h"
+#include "random.h"
+#include "camera.h"
+#include "material.h"
+#include "settings.h"
+#include "ppm.h"
+#include "aarect.h"
+#include "bvh.h"
+#include "instance.h"
+#include "animation.h"
+#include "trace.h"
+
+// Fixed part of a scene's camera path, matching its still camera
+void set_lens(camera_path& path, const vec4& vup, double aspect, double aperture, double focus_dist) {
+  path.vup = vup;
+  path.aspect = aspect;
+  path.aperture = aperture;
+  path.focus_dist = focus_dist;
+  path.time0 = 0.0;
+  path.time1 = 1.0;
+}
+
+// Closed orbit around 'lookat' at the height of 'lookfrom', starting there
+void add_orbit(camera_path& path, const vec4& lookfrom, const vec4& lookat, double vfov) {
+  vec4 arm = lookfrom - lookat;
+  double radius = sqrt(arm.x*arm.x + arm.z*arm.z);
+  double phi0 = atan2(arm.z, arm.x);
+  for (int k = 0; k <= 4; ++k) {
+    double phi = phi0 + k * 0.5 * double(M_PI);
+    path.lookfrom.add(0.25 * k, lookat + vec4(radius * cos(phi), arm.y, radius * sin(phi)));
+  }
+  path.lookat.add(0.0, lookat);
+  path.vfov.add(0.0, vfov);
+}
+
+void perlin_scene(hittable **scene, hittable **lightarea, camera **view, animation *anim, settings* s) {
+    
+    texture* color = new constant_texture(vec4(0.5, 0.5, 0.5));
+    texture *pertext = new noise_texture(4);
+    hittable **shapelist = new hittable*[2];
+    hittable **lightlist = new hittable*[1];
+
+    shapelist[0] = new sphere(vec4(0,-1000, 0), 1000, new lambertian(color));
+    shapelist[1] = new sphere(vec4(0, 2, 0), 2, new lambertian(pertext));
+
+    lightlist[0] = new sphere(vec4(0, 2, 0), 2, new lambertian(pertext));
+
+    *scene = new hittable_list(shapelist, 2);
+    *lightarea = new hittable_list(lightlist,1);
+
+    vec4 lookfrom(13, 2, 3);
+    vec4 lookat(0, 0, 0);
+    double dist_to_focus = 10.0;
+    double aperture = 0.0;
+    double vfov = 40.0;
+    double aspect = double(s->window_width) / double(s->window_height);
+    *view = new camera(lookfrom, lookat, vec4(0,1,0), vfov, aspect, aperture, dist_to_focus, 0.0, 1.0);
+
+    set_lens(anim->path, vec4(0,1,0), aspect, aperture, dist_to_focus);
+    add_orbit(anim->path, lookfrom, lookat, vfov);
+}
+void random_scene(hittable **scene, hittable **lightarea, camera **view, animation *anim, settings* s) {
+
+  int i = 0;
+  int l = 0;
+  int n = 0;
+  hittable **shapelist = new hittable*[500];
+  hittable **lightlist = new hittable*[500];
+  // The small static spheres end up packed into SIMD sphere_sets below
+  sphere **smalllist = new sphere*[500];
+
+  texture *checker = new checker_texture(
+    new constant_texture(vec4(0.2, 0.3, 0.1)),
+    new constant_texture(vec4(0.9, 0.9, 0.9)));
+
+  shapelist[i++] = new sphere(vec4(0,-1000,0), 1000, new lambertian(checker));
+  for (int a = -10; a < 10; a++) {
+    for (int b = -10; b < 10; b++) {
+      double choose_mat = random_double();
+      vec4 center(a+0.9*random_double(),0.2,b+0.9*random_double());
+      if ((center-vec4(4.0,0.2,0.0)).length() > 0.9) {
+        if (choose_mat < 0.5) {
+          smalllist[n++] = new sphere(center, 0.2,
+            new lambertian(new constant_texture(vec4(
+                                random_double()*random_double(),
+                                random_double()*random_double(),
+                                random_double()*random_double()))
+            )
+          );
+        }
+        else if (choose_mat < 0.75) { // light
+          smalllist[n++] = new sphere(center, 0.2,
+            new diffuse_light(new constant_texture(vec4(
+                                random_double()*random_double(),
+                                random_double()*random_double(),
+                                random_double()*random_double()))
+            )
+          );
+          lightlist[l++] = new sphere(center, 0.2,
+            new diffuse_light(new constant_texture(vec4(
+                                random_double()*random_double(),
+                                random_double()*random_double(),
+                                random_double()*random_double()))
+            )
+          );
+        }
+        else if (choose_mat < 0.8) {
+          shapelist[i++] = new moving_sphere(center,
+            center+vec4(0.0,0.5*random_double(),0.0),0.0,1.0, 0.2,
+            new lambertian(new constant_texture(vec4(
+                                random_double()*random_double(),
+                                random_double()*random_double(),
+                                random_double()*random_double()))
+            )
+          );
+        }
+        else if (choose_mat < 0.95) { // metal
+          smalllist[n++] = new sphere(center, 0.2,
+            new metal(vec4(0.5*(1.0 + random_double()),
+                           0.5*(1.0 + random_double()),
+                           0.5*(1.0 + random_double())),
+                           0.5*random_double()));
+        }
+        else { // glass
+           smalllist[n++] = new sphere(center, 0.2, new dielectric(1.5));
+        }
+      }
+    }
+  }
+
+  shapelist[i++] = new sphere(vec4(-4, 1, 0), 1.0, new lambertian(new constant_texture(vec4(0.4, 0.2, 0.1))));
+  shapelist[i++] = new sphere(vec4( 4, 1, 0), 1.0, new dielectric(1.5));
+  lightlist[l++] = new sphere(vec4( 4, 1, 0), 1.0, new dielectric(1.5));
+
+  ppm image("../data/test_images/earthmap.ppm");
+
+  shapelist[i++] = new sphere(vec4(0, 1, 0), 1.0, new lambertian(new image_texture(image.pix, image.width, image.height)));
+  shapelist[i++] = new sphere(vec4(0, 3, 0), 0.25, new diffuse_light(new constant_texture(vec4(4.0,4.0,4.0))));
+  shapelist[i++] = new sphere(vec4(8, 1, 0), 1.0,new metal(vec4(0.7, 0.6, 0.5), 0.0));
+
+  i += make_sphere_sets(smalllist, n, 8, shapelist + i);
+  for (int k = 0; k < n; ++k) delete smalllist[k];
+  delete[] smalllist;
+
+    {
+      TRACE_SCOPE("bvh build", "bvh");
+      *scene = new bvh_node(shapelist, i, 0.0, 1.0);
+    }
+    *lightarea = new hittable_list(lightlist,l);
+
+    vec4 lookfrom(13,2,3);
+    vec4 lookat(0,0,0);
+    double dist_to_focus = 10.0;
+    double aperture = 0.1;
+    double vfov = 40.0;
+    double aspect = double(s->window_width) / double(s->window_height);
+    *view = new camera(lookfrom, lookat, vec4(0,1,0), vfov, aspect, aperture, dist_to_focus, 0.0, 1.0);
+
+    set_lens(anim->path, vec4(0,1,0), aspect, aperture, dist_to_focus);
+    add_orbit(anim->path, lookfrom, lookat, vfov);
+}
+void cornell_box(hittable **scene, hittable **lightarea, camera **view, animation *anim, settings* s) {
+
+  int i = 0;
+  int l = 0;
+  hittable **shapelist = new hittable*[8];
+  hittable **lightlist = new hittable*[8];
+  material *red   = new lambertian(new constant_texture(vec4(0.65, 0.05, 0.05)));
+  material *white = new lambertian(new constant_texture(vec4(0.73, 0.73, 0.73)));
+  material *green = new lambertian(new constant_texture(vec4(0.12, 0.45, 0.15)));
+  material *light = new diffuse_light(new constant_texture(vec4(15.0, 15.0, 15.0)));
+  material *glass = new dielectric(1.5);
+  shapelist[i++] = new flip_normals(new yz_rect(0, 555, 0, 555, 555, green));
+  shapelist[i++] = new yz_rect(0, 555, 0, 555, 0, red);
+  shapelist[i++] = new flip_normals(new xz_rect(213, 343, 227, 332, 554,light));
+  lightlist[l++] = new flip_normals(new xz_rect(213, 343, 227, 332, 554,light));
+  shapelist[i++] = new flip_normals(new xz_rect(0, 555, 0, 555, 555, white));
+  shapelist[i++] = new xz_rect(0, 555, 0, 555, 0, white);
+  shapelist[i++] = new flip_normals(new xy_rect(0, 555, 0, 555, 555, white));
+  // Built around its own center so an animation can spin it in place
+  animated_instance tall_box;
+  tall_box.base = affine::translation(vec4(265, 0, 295)) * affine::rotation_y(15) * affine::translation(vec4(82.5, 0, 82.5));
+  tall_box.angle.add(0.0, 0.0);
+  tall_box.angle.add(1.0, 360.0);
+  tall_box.target = new instance(new box(vec4(-82.5, 0, -82.5), vec4(82.5, 330, 82.5), white), tall_box.base);
+  shapelist[i++] = tall_box.target;
+  anim->objects.push_back(tall_box);
+  shapelist[i++] = new sphere(vec4(190, 90, 190),90 , glass);
+  lightlist[l++] = new sphere(vec4(190, 90, 190),90 , glass);
+
+  anim->world = new dynamic_bvh(shapelist, i, 0.0, 1.0);
+  *scene = anim->world;
+  *lightarea = new hittable_list(lightlist,l);
+
+  vec4 lookfrom(278, 278, -800);
+  vec4 lookat(278, 278, 0);
+  double dist_to_focus = 10.0;
+  double aperture = 0.0;
+  double vfov = 40.0;
+  double aspect = double(s->window_width) / double(s->window_height);
+  *view = new camera(lookfrom, lookat, vec4(0,1,0), vfov, aspect, aperture, dist_to_focus, 0.0, 1.0);
+
+  // Dolly in towards the back wall and out again
+  set_lens(anim->path, vec4(0,1,0), aspect, aperture, dist_to_focus);
+  anim->path.lookfrom.add(0.0, lookfrom);
+  anim->path.lookfrom.add(0.5, vec4(278, 278, -450));
+  anim->path.lookfrom.add(1.0, lookfrom);
+  anim->path.lookat.add(0.0, lookat);
+  anim->path.vfov.add(0.0, vfov);
+}
+
+const char* scene_name(int scene_index) {
+  switch (scene_index) {
+    case 1: return "cornell_box";
+    case 2: return "perlin_scene";
+    default: return "random_scene";
+  }
+}
+
+void load_scene(int scene_index, hittable **scene, hittable **lightarea, camera **view, animation *anim, settings* s) {
+  TRACE_SCOPE("scene load", "scene", "index", scene_index);
+  switch (scene_index) {
+    case 0:
+      random_scene(scene, lightarea, view, anim, s);
+      break;
+    case 1:
+      cornell_box(scene, lightarea, view, anim, s);
+      break;
+    case 2:
+      perlin_scene(scene, lightarea, view, anim, s);
+      break;
+    default:
+      random_scene(scene, lightarea, view, anim, s);
+      break;
+  }
+}
+
+#endif
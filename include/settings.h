@@ -1,33 +1,224 @@
-/* Author: Diego Cosin <cosinma@esat-alumni.com>. */
-#ifndef __SETTINGS_H__
-#define __SETTINGS_H__ 1
-
-#include "INIReader.h"
-
-struct settings{
-  int window_width;
-  int window_height;
-  int num_samples;
-  double inv_num_samples;
-  bool progressive_render;
-  bool multithreaded;
-  bool output_to_file;
-  int scene_index;
-};
-
-settings ReadSettings(){
-  settings settings;
-  INIReader reader("../data/settings.ini");
-
-  settings.window_width  = reader.GetInteger("window","width",  800);
-  settings.window_height = reader.GetInteger("window","height", 600);
-  settings.num_samples = reader.GetInteger("render","samples", 50);
-  settings.inv_num_samples = 1.0 / settings.num_samples;
-  settings.progressive_render = reader.GetBoolean("render","progressive_render", true);
-  settings.multithreaded = reader.GetBoolean("render","multithreaded", false);
-  settings.output_to_file = reader.GetBoolean("general","output_to_file", true);
-  settings.scene_index = reader.GetInteger("general","scene_index", 0);
-  return settings;
-}
-
-#endif
+/* Author: Diego Cosin <cosinma@esat-alumni.com>. */
+#ifndef __SETTINGS_H__
+#define __SETTINGS_H__ 1
+
+#include <limits.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <functional>
+#include <string>
+#include <vector>
+#include <thread>
+#include "INIReader.h"
+
+struct settings{
+  int window_width;
+  int window_height;
+  int num_samples;
+  double inv_num_samples;
+  double max_sample_luminance;
+  bool progressive_render;
+  bool multithreaded;
+  bool output_to_file;
+  int scene_index;
+  int frames;
+  std::string aovs;
+  std::string output_format;
+  std::string exr_pixel_type;
+  std::string exr_compression;
+  bool exr_tiled;
+  std::string heatmap;
+  std::string trace;
+  bool denoise;
+  int denoise_iterations;
+  int threads;          // 0 uses every core, when multithreaded
+  std::string affinity; // none, cores or nodes, see affinity.h
+  bool numa;            // A copy of the scene per NUMA node, see numa.h
+  uint32_t seed;
+  int tile_size;
+  std::string output;   // Output path without the extension
+  bool headless;
+  double time_budget;   // Seconds, 0 renders every sample
+  std::string budget_reference;
+};
+
+const char* const kSettingsPath = "../data/settings.ini";
+
+settings ReadSettings(const char* path = kSettingsPath){
+  settings settings;
+  INIReader reader(path);
+  if (reader.ParseError() < 0)
+    fprintf(stderr, "Could not read %s, using the defaults\n", path);
+
+  settings.window_width  = reader.GetInteger("window","width",  800);
+  settings.window_height = reader.GetInteger("window","height", 600);
+  settings.num_samples = reader.GetInteger("render","samples", 50);
+  settings.inv_num_samples = 1.0 / settings.num_samples;
+  settings.max_sample_luminance = reader.GetReal("render","max_sample_luminance", 0.0);
+  settings.progressive_render = reader.GetBoolean("render","progressive_render", true);
+  settings.multithreaded = reader.GetBoolean("render","multithreaded", false);
+  settings.output_to_file = reader.GetBoolean("general","output_to_file", true);
+  settings.scene_index = reader.GetInteger("general","scene_index", 0);
+  settings.aovs = reader.Get("general","aovs", "");
+  settings.output_format = reader.Get("general","output_format", "png");
+  settings.exr_pixel_type = reader.Get("general","exr_pixel_type", "half");
+  settings.exr_compression = reader.Get("general","exr_compression", "zip");
+  settings.exr_tiled = reader.GetBoolean("general","exr_tiled", false);
+  settings.frames = reader.GetInteger("animation","frames", 1);
+  settings.heatmap = reader.Get("debug","heatmap", "off");
+  settings.trace = reader.Get("debug","trace", "");
+  settings.denoise = reader.GetBoolean("denoise","enabled", false);
+  settings.denoise_iterations = reader.GetInteger("denoise","iterations", 5);
+  settings.threads = reader.GetInteger("render","threads", 0);
+  settings.affinity = reader.Get("render","affinity", "none");
+  settings.numa = reader.GetBoolean("render","numa", false);
+  settings.seed = uint32_t(reader.GetInteger("render","seed", 1));
+  settings.tile_size = reader.GetInteger("render","tile_size", 64);
+  settings.time_budget = reader.GetReal("render","time_budget", 0.0);
+  settings.budget_reference = reader.Get("render","budget_reference", "");
+  settings.output = reader.Get("general","output", "../data/render");
+  settings.headless = reader.GetBoolean("general","headless", false);
+  return settings;
+}
+
+// Command line options, layered over settings.ini so a sweep doesn't need
+// an INI file per run. Each takes its value as --name value or --name=value.
+// A program adds its own options to these with program_option.
+struct program_option {
+  const char* name;   // Without the leading --
+  bool flag;          // Takes no value
+  const char* usage;  // Its lines in --help
+};
+
+// Takes one of the program's own options, with a nullptr value for a flag;
+// false for a bad value, after saying so
+typedef std::function<bool(const std::string& name, const char* value)> option_handler;
+
+void PrintUsage(FILE* f, const char* program, const std::vector<program_option>& extra = std::vector<program_option>()) {
+  fprintf(f, "Usage: %s [options]\n"
+             "  --config <file>       settings file (default %s)\n"
+             "  --width <px>          --height <px>\n"
+             "  --spp <n>             samples per pixel\n"
+             "  --threads <n>         render threads, 0 for every core, 1 renders on the\n"
+             "                        main thread (overrides multithreaded)\n"
+             "  --affinity <mode>     pin threads: none, cores or nodes\n"
+             "  --numa                copy the scene to every NUMA node\n"
+             "  --scene <index>\n"
+             "  --output <path>       output path without the extension\n"
+             "  --seed <n>\n"
+             "  --tile-size <px>\n"
+             "  --headless            render without a window\n"
+             "  --time-budget <s>     stop adding samples after this many seconds\n"
+             "  --reference <pfm>     image to measure a time-budgeted render against\n", program, kSettingsPath);
+  for (size_t i = 0; i < extra.size(); ++i) fputs(extra[i].usage, f);
+  fprintf(f, "  --help\n");
+}
+
+// The --config file, if one was given
+const char* SettingsPath(int argc, char** argv) {
+  for (int i = 1; i < argc; ++i) {
+    if (strcmp(argv[i], "--config") == 0 && i + 1 < argc) return argv[i + 1];
+    if (strncmp(argv[i], "--config=", 9) == 0) return argv[i] + 9;
+  }
+  return kSettingsPath;
+}
+
+// Applies the options in argv to 's', and hands the program's own, listed in
+// 'extra', to 'handle'. Arguments that are not options, unknown options and
+// bad values are reported on stderr and fail.
+bool ParseCommandLine(settings& s, int argc, char** argv, const std::vector<program_option>& extra = std::vector<program_option>(),
+                      const option_handler& handle = option_handler()) {
+  for (int i = 1; i < argc; ++i) {
+    const char* arg = argv[i];
+    if (strncmp(arg, "--", 2) != 0) {
+      fprintf(stderr, "Unexpected argument '%s'\n", arg);
+      return false;
+    }
+    std::string name = arg + 2;
+    const char* value = nullptr;
+    size_t eq = name.find('=');
+    if (eq != std::string::npos) {
+      value = arg + 2 + eq + 1;
+      name.resize(eq);
+    }
+    if (name == "help") {
+      PrintUsage(stdout, argv[0], extra);
+      exit(0);
+    }
+    const program_option* own = nullptr;
+    for (size_t k = 0; k < extra.size(); ++k)
+      if (name == extra[k].name) own = &extra[k];
+    if (name == "headless" || name == "numa" || (own != nullptr && own->flag)) {
+      if (value != nullptr) {
+        fprintf(stderr, "--%s takes no value\n", name.c_str());
+        return false;
+      }
+      if (own != nullptr) {
+        if (!handle(name, nullptr)) return false;
+      }
+      else if (name == "headless") {
+        s.headless = true;
+      }
+      else {
+        s.numa = true;
+      }
+      continue;
+    }
+    if (value == nullptr) {
+      if (i + 1 >= argc) {
+        fprintf(stderr, "--%s needs a value\n", name.c_str());
+        return false;
+      }
+      value = argv[++i];
+    }
+    if (own != nullptr) {
+      if (!handle(name, value)) return false;
+      continue;
+    }
+
+    char* end = nullptr;
+    double number = strtod(value, &end);
+    bool numeric = end != value && *end == '\0';
+    // Range checked before converting, which is undefined out of range;
+    // every integer option is a non-negative int but the seed
+    bool whole = numeric && number == floor(number);
+    bool count = whole && number >= 0.0 && number <= double(INT_MAX);
+    if (name == "config") continue;  // Already read, see SettingsPath
+    else if (name == "output") s.output = value;
+    else if (name == "reference") s.budget_reference = value;
+    else if (name == "affinity") s.affinity = value;
+    else if (name == "width" && count && number > 0) s.window_width = int(number);
+    else if (name == "height" && count && number > 0) s.window_height = int(number);
+    else if (name == "spp" && count && number > 0) s.num_samples = int(number);
+    else if (name == "threads" && count) {
+      s.threads = int(number);
+      s.multithreaded = s.threads != 1;
+    }
+    else if (name == "scene" && count) s.scene_index = int(number);
+    else if (name == "seed" && whole && number >= 0.0 && number <= double(UINT32_MAX)) s.seed = uint32_t(number);
+    else if (name == "tile-size" && count && number > 0) s.tile_size = int(number);
+    else if (name == "time-budget" && numeric && number >= 0) s.time_budget = number;
+    else {
+      bool known = name == "width" || name == "height" || name == "spp" || name == "threads" || name == "scene" ||
+                   name == "seed" || name == "tile-size" || name == "time-budget";
+      if (known) fprintf(stderr, "Bad value '%s' for --%s\n", value, name.c_str());
+      else fprintf(stderr, "Unknown option --%s, see --help\n", name.c_str());
+      return false;
+    }
+  }
+  s.inv_num_samples = 1.0 / s.num_samples;
+  return true;
+}
+
+// Threads to render with: one without multithreaded, otherwise 'threads'
+// or every core
+int RenderThreads(const settings& s) {
+  if (!s.multithreaded) return 1;
+  int threads = s.threads > 0 ? s.threads : int(std::thread::hardware_concurrency());
+  return threads > 0 ? threads : 1;
+}
+
+#endif
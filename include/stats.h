@@ -0,0 +1,189 @@
+/* Author: Diego Cosin <cosinma@esat-alumni.com>. */
+#ifndef __STATS_H__
+#define __STATS_H__ 1
+
+// Hot-path counters. Every thread counts into its own render_stats, so the
+// increments are plain adds on a thread-local block; gather_stats() sums the
+// live threads plus whatever finished threads left behind.
+//
+// Build with RT_STATS=1 to enable them. With the default of 0 the STAT_*
+// macros expand to nothing and none of this is compiled into the hot path.
+
+#ifndef RT_STATS
+#define RT_STATS 0
+#endif
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+#include <mutex>
+#include <chrono>
+#include <algorithm>
+
+// Longest path recorded in the bounce histogram; longer ones land in the
+// last bucket.
+const int kStatsMaxBounces = 8;
+
+enum stats_stage {
+  stage_scene_build,
+  stage_bvh_update,
+  stage_render,
+  stage_output,
+  stage_count
+};
+
+const char* stage_names[stage_count] = { "scene_build", "bvh_update", "render", "output" };
+
+struct render_stats {
+  uint64_t rays_specular;
+  uint64_t rays_diffuse;
+  uint64_t rays_light;
+  uint64_t bvh_nodes_visited;
+  uint64_t primitive_tests;
+  uint64_t hits;
+  uint64_t invalid_samples;
+  uint64_t paths;
+  uint64_t bounces[kStatsMaxBounces + 1];
+  // Summed over threads, so the render stage reports thread-seconds
+  double stage_seconds[stage_count];
+
+  render_stats() { clear(); }
+  void clear() { memset(this, 0, sizeof(*this)); }
+
+  render_stats& operator+=(const render_stats& o) {
+    rays_specular += o.rays_specular;
+    rays_diffuse += o.rays_diffuse;
+    rays_light += o.rays_light;
+    bvh_nodes_visited += o.bvh_nodes_visited;
+    primitive_tests += o.primitive_tests;
+    hits += o.hits;
+    invalid_samples += o.invalid_samples;
+    paths += o.paths;
+    for (int i = 0; i <= kStatsMaxBounces; ++i) bounces[i] += o.bounces[i];
+    for (int i = 0; i < stage_count; ++i) stage_seconds[i] += o.stage_seconds[i];
+    return *this;
+  }
+
+  // Every camera ray starts one path; thread_rays counts them too, in every build
+  uint64_t rays_camera() const { return paths; }
+  uint64_t rays_total() const { return rays_camera() + rays_specular + rays_diffuse + rays_light; }
+};
+
+// Registry of every thread's block. A thread folds its counts into 'retired'
+// when it exits, so nothing is lost when worker pools are torn down.
+struct stats_registry {
+  std::mutex mux;
+  std::vector<render_stats*> live;
+  render_stats retired;
+};
+
+stats_registry& stats_threads() {
+  static stats_registry registry;
+  return registry;
+}
+
+struct thread_stats_block {
+  render_stats counters;
+
+  thread_stats_block() {
+    stats_registry& r = stats_threads();
+    std::lock_guard<std::mutex> lock(r.mux);
+    r.live.push_back(&counters);
+  }
+  ~thread_stats_block() {
+    stats_registry& r = stats_threads();
+    std::lock_guard<std::mutex> lock(r.mux);
+    r.retired += counters;
+    r.live.erase(std::remove(r.live.begin(), r.live.end(), &counters), r.live.end());
+  }
+};
+
+inline render_stats& thread_stats() {
+  thread_local thread_stats_block block;
+  return block.counters;
+}
+
+// Only meaningful while the workers are idle (between passes or frames).
+render_stats gather_stats() {
+  stats_registry& r = stats_threads();
+  std::lock_guard<std::mutex> lock(r.mux);
+  render_stats total = r.retired;
+  for (size_t i = 0; i < r.live.size(); ++i) total += *r.live[i];
+  return total;
+}
+
+void reset_stats() {
+  stats_registry& r = stats_threads();
+  std::lock_guard<std::mutex> lock(r.mux);
+  r.retired.clear();
+  for (size_t i = 0; i < r.live.size(); ++i) r.live[i]->clear();
+}
+
+// Adds the lifetime of the scope to one stage of the calling thread.
+struct stage_timer {
+  explicit stage_timer(stats_stage st) : stage(st), start(std::chrono::high_resolution_clock::now()) {}
+  ~stage_timer() {
+    thread_stats().stage_seconds[stage] += std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+  }
+  stats_stage stage;
+  std::chrono::high_resolution_clock::time_point start;
+};
+
+void print_stats(FILE* f, const render_stats& st) {
+  double paths = st.paths > 0 ? double(st.paths) : 1.0;
+  double rays = st.rays_total() > 0 ? double(st.rays_total()) : 1.0;
+  fprintf(f, "Rays: %llu camera, %llu specular, %llu diffuse, %llu light (%llu total)\n",
+          (unsigned long long)st.rays_camera(), (unsigned long long)st.rays_specular,
+          (unsigned long long)st.rays_diffuse, (unsigned long long)st.rays_light,
+          (unsigned long long)st.rays_total());
+  fprintf(f, "BVH nodes visited: %llu (%.2f per ray)\n", (unsigned long long)st.bvh_nodes_visited, st.bvh_nodes_visited / rays);
+  fprintf(f, "Primitive tests: %llu (%.2f per ray)\n", (unsigned long long)st.primitive_tests, st.primitive_tests / rays);
+  fprintf(f, "Hits: %llu\n", (unsigned long long)st.hits);
+  fprintf(f, "Invalid samples: %llu\n", (unsigned long long)st.invalid_samples);
+  fprintf(f, "Bounces per path:");
+  for (int i = 0; i <= kStatsMaxBounces; ++i)
+    if (st.bounces[i] > 0) fprintf(f, " %d%s: %.1f%%", i, i == kStatsMaxBounces ? "+" : "", 100.0 * st.bounces[i] / paths);
+  fprintf(f, "\n");
+  fprintf(f, "Stage seconds:");
+  for (int i = 0; i < stage_count; ++i) fprintf(f, " %s %.3f", stage_names[i], st.stage_seconds[i]);
+  fprintf(f, "\n");
+}
+
+// Writes the counters as one JSON object (no trailing newline), indented by
+// 'indent' spaces, for embedding into a larger document.
+void write_stats_json(FILE* f, const render_stats& st, int indent) {
+  fprintf(f, "{\n");
+  fprintf(f, "%*s\"rays_camera\": %llu,\n", indent + 2, "", (unsigned long long)st.rays_camera());
+  fprintf(f, "%*s\"rays_specular\": %llu,\n", indent + 2, "", (unsigned long long)st.rays_specular);
+  fprintf(f, "%*s\"rays_diffuse\": %llu,\n", indent + 2, "", (unsigned long long)st.rays_diffuse);
+  fprintf(f, "%*s\"rays_light\": %llu,\n", indent + 2, "", (unsigned long long)st.rays_light);
+  fprintf(f, "%*s\"bvh_nodes_visited\": %llu,\n", indent + 2, "", (unsigned long long)st.bvh_nodes_visited);
+  fprintf(f, "%*s\"primitive_tests\": %llu,\n", indent + 2, "", (unsigned long long)st.primitive_tests);
+  fprintf(f, "%*s\"hits\": %llu,\n", indent + 2, "", (unsigned long long)st.hits);
+  fprintf(f, "%*s\"invalid_samples\": %llu,\n", indent + 2, "", (unsigned long long)st.invalid_samples);
+  fprintf(f, "%*s\"paths\": %llu,\n", indent + 2, "", (unsigned long long)st.paths);
+  fprintf(f, "%*s\"bounces\": [", indent + 2, "");
+  for (int i = 0; i <= kStatsMaxBounces; ++i) fprintf(f, "%s%llu", i ? ", " : "", (unsigned long long)st.bounces[i]);
+  fprintf(f, "],\n");
+  fprintf(f, "%*s\"stage_seconds\": {", indent + 2, "");
+  for (int i = 0; i < stage_count; ++i) fprintf(f, "%s\"%s\": %.6f", i ? ", " : "", stage_names[i], st.stage_seconds[i]);
+  fprintf(f, "}\n");
+  fprintf(f, "%*s}", indent, "");
+}
+
+#if RT_STATS
+#define STAT_INC(counter) (thread_stats().counter++)
+#define STAT_ADD(counter, n) (thread_stats().counter += (n))
+#define STAT_BOUNCES(depth) (thread_stats().paths++, thread_stats().bounces[(depth) < kStatsMaxBounces ? (depth) : kStatsMaxBounces]++)
+#define STAT_CONCAT_(a, b) a##b
+#define STAT_CONCAT(a, b) STAT_CONCAT_(a, b)
+#define STAT_TIMER(stage) stage_timer STAT_CONCAT(stat_timer_, __LINE__)(stage)
+#else
+#define STAT_INC(counter) ((void)0)
+#define STAT_ADD(counter, n) ((void)0)
+#define STAT_BOUNCES(depth) ((void)0)
+#define STAT_TIMER(stage) ((void)0)
+#endif
+
+#endif
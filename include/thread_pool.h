@@ -0,0 +1,86 @@
+/* Author: Diego Cosin <cosinma@esat-alumni.com>. */
+#ifndef __THREAD_POOL_H__
+#define __THREAD_POOL_H__ 1
+
+// A fixed set of helper threads for work that comes back every frame (BVH
+// refits, denoiser passes), so each round costs a wakeup instead of thread
+// creation. run() hands items out to the helpers and the calling thread and
+// returns once all of them are done; every helper checks in on every round,
+// so nothing of a round is still running when the next one starts.
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class thread_pool {
+ public:
+  // 'helpers' threads besides the one calling run()
+  explicit thread_pool(int helpers) {
+    for (int i = 0; i < helpers; ++i) threads.push_back(std::thread(&thread_pool::work, this));
+  }
+
+  ~thread_pool() {
+    {
+      std::unique_lock<std::mutex> lock(mux);
+      stopping = true;
+    }
+    wake.notify_all();
+    for (size_t i = 0; i < threads.size(); ++i) threads[i].join();
+  }
+
+  // Threads run() spreads the items over, the caller included
+  int size() const { return int(threads.size()) + 1; }
+
+  // Calls body(i) for every i in [0, count), in any order and on any thread
+  void run(int count, const std::function<void(int)>& body) {
+    if (threads.empty() || count <= 1) {
+      for (int i = 0; i < count; ++i) body(i);
+      return;
+    }
+    {
+      std::unique_lock<std::mutex> lock(mux);
+      job = &body;
+      items = count;
+      next = 0;
+      checked_in = 0;
+      ++round;
+    }
+    wake.notify_all();
+    for (int i = next++; i < count; i = next++) body(i);
+    std::unique_lock<std::mutex> lock(mux);
+    done.wait(lock, [this]() { return checked_in == threads.size(); });
+    job = nullptr;
+  }
+
+ private:
+  void work() {
+    unsigned seen = 0;
+    std::unique_lock<std::mutex> lock(mux);
+    for (;;) {
+      wake.wait(lock, [&]() { return stopping || round != seen; });
+      if (stopping) return;
+      seen = round;
+      const std::function<void(int)>& body = *job;
+      int count = items;
+      lock.unlock();
+      for (int i = next++; i < count; i = next++) body(i);
+      lock.lock();
+      if (++checked_in == threads.size()) done.notify_one();
+    }
+  }
+
+  std::vector<std::thread> threads;
+  std::mutex mux;
+  std::condition_variable wake, done;
+  const std::function<void(int)>* job = nullptr;
+  int items = 0;
+  std::atomic<int> next{ 0 };
+  size_t checked_in = 0;
+  unsigned round = 0;
+  bool stopping = false;
+};
+
+#endif
@@ -0,0 +1,147 @@
+/* Author: Diego Cosin <cosinma@esat-alumni.com>. */
+#ifndef __TRACE_H__
+#define __TRACE_H__ 1
+
+// Timeline capture in the Chrome trace event format (load the file in
+// chrome://tracing or ui.perfetto.dev). Every thread appends complete events
+// to its own buffer, so recording takes no locks; buffers are owned by the
+// registry and outlive their threads, so worker pools can come and go.
+//
+// Nothing is recorded until trace_start() is called. A TRACE_SCOPE in a
+// disabled trace costs one relaxed load.
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+
+struct trace_event {
+  const char* name;
+  const char* category;
+  double start_us;
+  double duration_us;
+  // Up to two integer arguments, shown when the event is selected
+  const char* arg_name[2];
+  int arg_value[2];
+};
+
+struct trace_thread {
+  int tid;
+  std::string name;
+  std::vector<trace_event> events;
+};
+
+struct trace_registry {
+  std::mutex mux;
+  std::vector<trace_thread*> threads;
+  std::atomic<bool> enabled;
+  std::chrono::steady_clock::time_point origin;
+
+  trace_registry() : enabled(false), origin(std::chrono::steady_clock::now()) {}
+};
+
+trace_registry& trace_state() {
+  static trace_registry registry;
+  return registry;
+}
+
+inline bool trace_enabled() {
+  return trace_state().enabled.load(std::memory_order_relaxed);
+}
+
+inline double trace_now_us() {
+  return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - trace_state().origin).count();
+}
+
+trace_thread& trace_current_thread() {
+  thread_local trace_thread* current = nullptr;
+  if (current == nullptr) {
+    trace_registry& r = trace_state();
+    std::lock_guard<std::mutex> lock(r.mux);
+    current = new trace_thread();
+    current->tid = int(r.threads.size());
+    r.threads.push_back(current);
+  }
+  return *current;
+}
+
+// Label for the calling thread's row in the viewer
+void trace_thread_name(const std::string& name) {
+  trace_current_thread().name = name;
+}
+
+void trace_start() {
+  trace_state().enabled = true;
+}
+
+void trace_stop() {
+  trace_state().enabled = false;
+}
+
+// Records one complete event from the lifetime of the scope. 'name' and the
+// argument names must be string literals (they are stored, not copied).
+struct trace_scope {
+  trace_scope(const char* name, const char* category,
+              const char* arg0 = nullptr, int value0 = 0,
+              const char* arg1 = nullptr, int value1 = 0) : active(trace_enabled()) {
+    if (!active) return;
+    event.name = name;
+    event.category = category;
+    event.arg_name[0] = arg0;
+    event.arg_value[0] = value0;
+    event.arg_name[1] = arg1;
+    event.arg_value[1] = value1;
+    event.start_us = trace_now_us();
+  }
+  ~trace_scope() {
+    if (!active) return;
+    event.duration_us = trace_now_us() - event.start_us;
+    trace_current_thread().events.push_back(event);
+  }
+
+  bool active;
+  trace_event event;
+};
+
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+#define TRACE_SCOPE(...) trace_scope TRACE_CONCAT(trace_scope_, __LINE__)(__VA_ARGS__)
+
+// Writes every recorded event. Call it once the workers are idle or joined.
+bool trace_write(const char* path) {
+  FILE* f = fopen(path, "w");
+  if (f == nullptr) return false;
+  trace_registry& r = trace_state();
+  std::lock_guard<std::mutex> lock(r.mux);
+
+  fprintf(f, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+  bool first = true;
+  for (size_t t = 0; t < r.threads.size(); ++t) {
+    const trace_thread& th = *r.threads[t];
+    if (!th.name.empty()) {
+      fprintf(f, "%s{\"ph\": \"M\", \"name\": \"thread_name\", \"pid\": 1, \"tid\": %d, \"args\": {\"name\": \"%s\"}}",
+              first ? "" : ",\n", th.tid, th.name.c_str());
+      first = false;
+    }
+    for (size_t i = 0; i < th.events.size(); ++i) {
+      const trace_event& e = th.events[i];
+      fprintf(f, "%s{\"ph\": \"X\", \"name\": \"%s\", \"cat\": \"%s\", \"pid\": 1, \"tid\": %d, \"ts\": %.3f, \"dur\": %.3f",
+              first ? "" : ",\n", e.name, e.category, th.tid, e.start_us, e.duration_us);
+      first = false;
+      if (e.arg_name[0] != nullptr) {
+        fprintf(f, ", \"args\": {\"%s\": %d", e.arg_name[0], e.arg_value[0]);
+        if (e.arg_name[1] != nullptr) fprintf(f, ", \"%s\": %d", e.arg_name[1], e.arg_value[1]);
+        fprintf(f, "}");
+      }
+      fprintf(f, "}");
+    }
+  }
+  fprintf(f, "\n]}\n");
+  fclose(f);
+  return true;
+}
+
+#endif
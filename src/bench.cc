@@ -0,0 +1,307 @@
+/* Author: Diego Cosin <cosinma@esat-alumni.com>. */
+
+// Microbenchmarks for the hot-path kernels. Every benchmark body performs a
+// fixed batch of operations; the number of calls per repetition is calibrated
+// so one repetition takes about 50ms, and the median over all repetitions is
+// reported as ns/op and Mops/s.
+//
+// Covers vec4 math, box and primitive tests, BVH traversal, textures and the
+// samplers in random.h.
+//
+// Usage: RayTracerBench [name filter] [repetitions]
+
+#define _CRT_SECURE_NO_WARNINGS
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <new>
+#include <vector>
+#include <chrono>
+#include <algorithm>
+#include "float.h"
+#include "ray.h"
+#include "aabb.h"
+#include "random.h"
+#include "dispatch.h"
+#include "ppm.h"
+
+// Results are folded in here so the compiler can't drop the work
+static volatile double sink = 0.0;
+
+static const char* filter = nullptr;
+static int repetitions = 15;
+
+template <typename T>
+T* aligned_array(int n) {
+  T* p = (T*)_mm_malloc(n * sizeof(T), 32);
+  for (int i = 0; i < n; ++i) ::new (p + i) T();
+  return p;
+}
+
+template <typename F>
+void run(const char* name, int ops_per_call, F body) {
+  if (filter != nullptr && strstr(name, filter) == nullptr)
+    return;
+  typedef std::chrono::high_resolution_clock clock;
+
+  // Calibrate: double the calls until one repetition takes ~50ms
+  long long calls = 1;
+  for (;;) {
+    auto t0 = clock::now();
+    for (long long c = 0; c < calls; ++c) body();
+    double elapsed = std::chrono::duration<double>(clock::now() - t0).count();
+    if (elapsed > 0.05 || calls > (1ll << 40)) break;
+    calls *= elapsed > 0.005 ? int(0.05 / elapsed) + 1 : 2;
+  }
+
+  std::vector<double> ns_per_op;
+  for (int rep = 0; rep < repetitions; ++rep) {
+    auto t0 = clock::now();
+    for (long long c = 0; c < calls; ++c) body();
+    double elapsed = std::chrono::duration<double>(clock::now() - t0).count();
+    ns_per_op.push_back(elapsed * 1e9 / (double(calls) * ops_per_call));
+  }
+  std::sort(ns_per_op.begin(), ns_per_op.end());
+  double median = ns_per_op[ns_per_op.size() / 2];
+  double spread = 100.0 * (ns_per_op.back() - ns_per_op.front()) / median;
+  printf("%-32s %10.3f ns/op %10.2f Mops/s   (min %.3f, max %.3f, spread %.1f%%)\n",
+         name, median, 1e3 / median, ns_per_op.front(), ns_per_op.back(), spread);
+}
+
+static const int kRays = 1024;
+static const int kMask = kRays - 1;
+
+vec4 random_vec(double lo, double hi) {
+  return vec4(lo + (hi - lo) * random_double(), lo + (hi - lo) * random_double(), lo + (hi - lo) * random_double());
+}
+
+void bench_vec4() {
+  vec4* a = aligned_array<vec4>(kRays);
+  vec4* b = aligned_array<vec4>(kRays);
+  for (int i = 0; i < kRays; ++i) {
+    a[i] = random_vec(-1, 1);
+    b[i] = random_vec(-1, 1);
+  }
+
+  run("vec4 add", kRays, [&]() {
+    vec4 acc;
+    for (int i = 0; i < kRays; ++i) acc += a[i] + b[i];
+    sink = sink + acc.x;
+  });
+  run("vec4 mul", kRays, [&]() {
+    vec4 acc;
+    for (int i = 0; i < kRays; ++i) acc += a[i] * b[i];
+    sink = sink + acc.x;
+  });
+  run("vec4 scale", kRays, [&]() {
+    vec4 acc;
+    for (int i = 0; i < kRays; ++i) acc += a[i] * 0.5;
+    sink = sink + acc.x;
+  });
+  run("vec4 div", kRays, [&]() {
+    vec4 acc;
+    for (int i = 0; i < kRays; ++i) acc += a[i] / b[i];
+    sink = sink + acc.x;
+  });
+  run("vec4 normalized", kRays, [&]() {
+    vec4 acc;
+    for (int i = 0; i < kRays; ++i) acc += a[i].normalized();
+    sink = sink + acc.x;
+  });
+  run("dot", kRays, [&]() {
+    double acc = 0.0;
+    for (int i = 0; i < kRays; ++i) acc += dot(a[i], b[i]);
+    sink = sink + acc;
+  });
+  run("cross", kRays, [&]() {
+    vec4 acc;
+    for (int i = 0; i < kRays; ++i) acc += cross(a[i], b[i]);
+    sink = sink + acc.x;
+  });
+}
+
+void bench_aabb() {
+  ray* rays = aligned_array<ray>(kRays);
+  aabb* boxes = aligned_array<aabb>(kRays);
+  for (int i = 0; i < kRays; ++i) {
+    rays[i] = ray(random_vec(-10, 10), random_vec(-1, 1));
+    vec4 c = random_vec(-5, 5);
+    vec4 e = random_vec(0.1, 3);
+    boxes[i] = aabb(c - e, c + e);
+  }
+
+  run("aabb::hit_reference", kRays, [&]() {
+    int hits = 0;
+    for (int i = 0; i < kRays; ++i)
+      hits += boxes[(i * 7) & kMask].hit_reference(rays[i], 0.001, DBL_MAX);
+    sink = sink + hits;
+  });
+  run("aabb::hit", kRays, [&]() {
+    int hits = 0;
+    for (int i = 0; i < kRays; ++i)
+      hits += boxes[(i * 7) & kMask].hit(rays[i], 0.001, DBL_MAX);
+    sink = sink + hits;
+  });
+}
+
+void bench_primitives() {
+  ray* rays = aligned_array<ray>(kRays);
+  for (int i = 0; i < kRays; ++i) {
+    vec4 origin = random_vec(-10, 10);
+    vec4 target = random_vec(-2, 2);
+    rays[i] = ray(origin, target - origin);
+  }
+
+  sphere ball(vec4(0, 0, 0), 1.5, nullptr);
+  run("sphere::hit", kRays, [&]() {
+    int hits = 0;
+    hit_record rec;
+    for (int i = 0; i < kRays; ++i) hits += ball.hit(rays[i], 0.001, DBL_MAX, rec);
+    sink = sink + hits;
+  });
+
+  xy_rect xy(-2, 2, -2, 2, 0, nullptr);
+  xz_rect xz(-2, 2, -2, 2, 0, nullptr);
+  yz_rect yz(-2, 2, -2, 2, 0, nullptr);
+  run("xy_rect::hit", kRays, [&]() {
+    int hits = 0;
+    hit_record rec;
+    for (int i = 0; i < kRays; ++i) hits += xy.hit(rays[i], 0.001, DBL_MAX, rec);
+    sink = sink + hits;
+  });
+  run("xz_rect::hit", kRays, [&]() {
+    int hits = 0;
+    hit_record rec;
+    for (int i = 0; i < kRays; ++i) hits += xz.hit(rays[i], 0.001, DBL_MAX, rec);
+    sink = sink + hits;
+  });
+  run("yz_rect::hit", kRays, [&]() {
+    int hits = 0;
+    hit_record rec;
+    for (int i = 0; i < kRays; ++i) hits += yz.hit(rays[i], 0.001, DBL_MAX, rec);
+    sink = sink + hits;
+  });
+
+  // A random_scene-sized field of small spheres, individually and packed
+  const int kSpheres = 484;
+  hittable** list = new hittable*[kSpheres];
+  sphere** spheres = new sphere*[kSpheres];
+  for (int i = 0; i < kSpheres; ++i) {
+    spheres[i] = new sphere(vec4(-11 + (i % 22) + 0.9 * random_double(), 0.2, -11 + (i / 22) + 0.9 * random_double()), 0.2, nullptr);
+    list[i] = spheres[i];
+  }
+  bvh_node* field = new bvh_node(list, kSpheres, 0.0, 1.0);
+  hittable** sets = new hittable*[kSpheres];
+  int nsets = make_sphere_sets(spheres, kSpheres, 8, sets);
+  bvh_node* packed = new bvh_node(sets, nsets, 0.0, 1.0);
+
+  ray* camera_rays = aligned_array<ray>(kRays);
+  for (int i = 0; i < kRays; ++i) {
+    vec4 origin(13, 2, 3);
+    camera_rays[i] = ray(origin, vec4(-11 + 22 * random_double(), 0.2 * random_double(), -11 + 22 * random_double()) - origin);
+  }
+  run("bvh_node traversal (spheres)", kRays, [&]() {
+    int hits = 0;
+    hit_record rec;
+    for (int i = 0; i < kRays; ++i) hits += dispatch_hit(field, camera_rays[i], 0.001, DBL_MAX, rec);
+    sink = sink + hits;
+  });
+  run("bvh_node traversal (sphere_set)", kRays, [&]() {
+    int hits = 0;
+    hit_record rec;
+    for (int i = 0; i < kRays; ++i) hits += dispatch_hit(packed, camera_rays[i], 0.001, DBL_MAX, rec);
+    sink = sink + hits;
+  });
+}
+
+void bench_textures() {
+  vec4* points = aligned_array<vec4>(kRays);
+  double* us = new double[kRays];
+  double* vs = new double[kRays];
+  for (int i = 0; i < kRays; ++i) {
+    points[i] = random_vec(-4, 4);
+    us[i] = random_double();
+    vs[i] = random_double();
+  }
+
+  perlin noise;
+  run("perlin::turb", kRays, [&]() {
+    double acc = 0.0;
+    for (int i = 0; i < kRays; ++i) acc += noise.turb(points[i]);
+    sink = sink + acc;
+  });
+
+  ppm image("../data/test_images/earthmap.ppm");
+  if (image.width == 0) {
+    // Fall back to a synthetic image when run from another directory
+    image.width = 1024;
+    image.height = 512;
+    image.pix = (uint8_t*)malloc(3 * image.width * image.height);
+    for (int i = 0; i < 3 * image.width * image.height; ++i) image.pix[i] = uint8_t(i * 31);
+  }
+  image_texture earth(image.pix, image.width, image.height);
+  run("image_texture::value", kRays, [&]() {
+    vec4 acc;
+    for (int i = 0; i < kRays; ++i) acc += earth.value(us[i], vs[i], points[i]);
+    sink = sink + acc.x;
+  });
+}
+
+void bench_samplers() {
+  const int kBatch = 256;
+  run("random_double", kBatch, [&]() {
+    double acc = 0.0;
+    for (int i = 0; i < kBatch; ++i) acc += random_double();
+    sink = sink + acc;
+  });
+  run("random_cosine_direction", kBatch, [&]() {
+    vec4 acc;
+    for (int i = 0; i < kBatch; ++i) acc += random_cosine_direction();
+    sink = sink + acc.x;
+  });
+  run("random_to_sphere", kBatch, [&]() {
+    vec4 acc;
+    for (int i = 0; i < kBatch; ++i) acc += random_to_sphere(1.0, 25.0);
+    sink = sink + acc.x;
+  });
+  run("random_in_unit_disk", kBatch, [&]() {
+    vec4 acc;
+    for (int i = 0; i < kBatch; ++i) acc += random_in_unit_disk();
+    sink = sink + acc.x;
+  });
+  run("random_in_unit_sphere", kBatch, [&]() {
+    vec4 acc;
+    for (int i = 0; i < kBatch; ++i) acc += random_in_unit_sphere();
+    sink = sink + acc.x;
+  });
+  run("random_on_unit_sphere", kBatch, [&]() {
+    vec4 acc;
+    for (int i = 0; i < kBatch; ++i) acc += random_on_unit_sphere();
+    sink = sink + acc.x;
+  });
+  cosine_pdf cosine(vec4(0, 1, 0));
+  run("cosine_pdf::generate", kBatch, [&]() {
+    vec4 acc;
+    for (int i = 0; i < kBatch; ++i) acc += cosine.generate();
+    sink = sink + acc.x;
+  });
+  sphere light(vec4(0, 3, 0), 0.5, nullptr);
+  hittable_pdf towards_light(&light, vec4(0, 0, 0));
+  run("hittable_pdf::generate (sphere)", kBatch, [&]() {
+    vec4 acc;
+    for (int i = 0; i < kBatch; ++i) acc += towards_light.generate();
+    sink = sink + acc.x;
+  });
+}
+
+int main(int argc, char** argv) {
+  if (argc > 1) filter = argv[1];
+  if (argc > 2) repetitions = atoi(argv[2]) > 0 ? atoi(argv[2]) : repetitions;
+
+  bench_vec4();
+  bench_aabb();
+  bench_primitives();
+  bench_textures();
+  bench_samplers();
+  return 0;
+}
@@ -1,572 +1,792 @@
-/* Author: Diego Cosin <cosinma@esat-alumni.com>. */
-
-#define _CRT_SECURE_NO_WARNINGS
-#include <stdlib.h>
-#include <iostream>
-#include <fstream>
-#include <time.h>
-#include <thread>
-#include <mutex>
-#include <atomic>
-#include <chrono>
-#include "float.h"
-#include "hittable_list.h"
-#include "sphere.h"
-#include "random.h"
-#include "camera.h"
-#include "material.h"
-#include "settings.h"
-#include "ppm.h"
-#include "aarect.h"
-// #include "constant_medium.h"
-#include "bvh.h"
-#include "pdf.h"
-
-#include <glad/glad.h>
-#include <GLFW/glfw3.h>
-#define STB_IMAGE_IMPLEMENTATION
-#include <stb/stb_image.h>
-#define STB_IMAGE_WRITE_IMPLEMENTATION
-#include <stb/stb_image_write.h>
-
-void perlin_scene(hittable **scene, hittable **lightarea, camera **view, settings* s) {
-    
-    texture* color = new constant_texture(vec4(0.5, 0.5, 0.5));
-    texture *pertext = new noise_texture(4);
-    hittable **shapelist = new hittable*[2];
-    hittable **lightlist = new hittable*[1];
-
-    shapelist[0] = new sphere(vec4(0,-1000, 0), 1000, new lambertian(color));
-    shapelist[1] = new sphere(vec4(0, 2, 0), 2, new lambertian(pertext));
-
-    lightlist[0] = new sphere(vec4(0, 2, 0), 2, new lambertian(pertext));
-
-    *scene = new hittable_list(shapelist, 2);
-    *lightarea = new hittable_list(lightlist,1);
-
-    vec4 lookfrom(13, 2, 3);
-    vec4 lookat(0, 0, 0);
-    double dist_to_focus = 10.0;
-    double aperture = 0.0;
-    double vfov = 40.0;
-    double aspect = double(s->window_width) / double(s->window_height);
-    *view = new camera(lookfrom, lookat, vec4(0,1,0), vfov, aspect, aperture, dist_to_focus, 0.0, 1.0);
-
-}
-void random_scene(hittable **scene, hittable **lightarea, camera **view, settings* s) {
-
-  int i = 0;
-  int l = 0;
-  hittable **shapelist = new hittable*[500];
-  hittable **lightlist = new hittable*[500];
-
-  texture *checker = new checker_texture(
-    new constant_texture(vec4(0.2, 0.3, 0.1)),
-    new constant_texture(vec4(0.9, 0.9, 0.9)));
-
-  shapelist[i++] = new sphere(vec4(0,-1000,0), 1000, new lambertian(checker));
-  for (int a = -10; a < 10; a++) {
-    for (int b = -10; b < 10; b++) {
-      double choose_mat = random_double();
-      vec4 center(a+0.9*random_double(),0.2,b+0.9*random_double());
-      if ((center-vec4(4.0,0.2,0.0)).length() > 0.9) {
-        if (choose_mat < 0.5) {
-          shapelist[i++] = new sphere(center, 0.2,
-            new lambertian(new constant_texture(vec4(
-                                random_double()*random_double(),
-                                random_double()*random_double(),
-                                random_double()*random_double()))
-            )
-          );
-        }
-        else if (choose_mat < 0.75) { // light
-          shapelist[i++] = new sphere(center, 0.2,
-            new diffuse_light(new constant_texture(vec4(
-                                random_double()*random_double(),
-                                random_double()*random_double(),
-                                random_double()*random_double()))
-            )
-          );
-          lightlist[l++] = new sphere(center, 0.2,
-            new diffuse_light(new constant_texture(vec4(
-                                random_double()*random_double(),
-                                random_double()*random_double(),
-                                random_double()*random_double()))
-            )
-          );
-        }
-        else if (choose_mat < 0.8) {
-          shapelist[i++] = new moving_sphere(center,
-            center+vec4(0.0,0.5*random_double(),0.0),0.0,1.0, 0.2,
-            new lambertian(new constant_texture(vec4(
-                                random_double()*random_double(),
-                                random_double()*random_double(),
-                                random_double()*random_double()))
-            )
-          );
-        }
-        else if (choose_mat < 0.95) { // metal
-          shapelist[i++] = new sphere(center, 0.2,
-            new metal(vec4(0.5*(1.0 + random_double()),
-                           0.5*(1.0 + random_double()),
-                           0.5*(1.0 + random_double())),
-                           0.5*random_double()));
-        }
-        else { // glass
-           shapelist[i++] = new sphere(center, 0.2, new dielectric(1.5));
-        }
-      }
-    }
-  }
-
-  shapelist[i++] = new sphere(vec4(-4, 1, 0), 1.0, new lambertian(new constant_texture(vec4(0.4, 0.2, 0.1))));
-  shapelist[i++] = new sphere(vec4( 4, 1, 0), 1.0, new dielectric(1.5));
-  lightlist[l++] = new sphere(vec4( 4, 1, 0), 1.0, new dielectric(1.5));
-
-  ppm image("../data/test_images/earthmap.ppm");
-
-  shapelist[i++] = new sphere(vec4(0, 1, 0), 1.0, new lambertian(new image_texture(image.pix, image.width, image.height)));
-  shapelist[i++] = new sphere(vec4(0, 3, 0), 0.25, new diffuse_light(new constant_texture(vec4(4.0,4.0,4.0))));
-  shapelist[i++] = new sphere(vec4(8, 1, 0), 1.0,new metal(vec4(0.7, 0.6, 0.5), 0.0));
-
-    *scene = new hittable_list(shapelist,i);
-    *lightarea = new hittable_list(lightlist,l);
-
-    vec4 lookfrom(13,2,3);
-    vec4 lookat(0,0,0);
-    double dist_to_focus = 10.0;
-    double aperture = 0.1;
-    double vfov = 40.0;
-    double aspect = double(s->window_width) / double(s->window_height);
-    *view = new camera(lookfrom, lookat, vec4(0,1,0), vfov, aspect, aperture, dist_to_focus, 0.0, 1.0);
-}
-void cornell_box(hittable **scene, hittable **lightarea, camera **view, settings* s) {
-
-  int i = 0;
-  int l = 0;
-  hittable **shapelist = new hittable*[8];
-  hittable **lightlist = new hittable*[8];
-  material *red   = new lambertian(new constant_texture(vec4(0.65, 0.05, 0.05)));
-  material *white = new lambertian(new constant_texture(vec4(0.73, 0.73, 0.73)));
-  material *green = new lambertian(new constant_texture(vec4(0.12, 0.45, 0.15)));
-  material *light = new diffuse_light(new constant_texture(vec4(15.0, 15.0, 15.0)));
-  material *glass = new dielectric(1.5);
-  shapelist[i++] = new flip_normals(new yz_rect(0, 555, 0, 555, 555, green));
-  shapelist[i++] = new yz_rect(0, 555, 0, 555, 0, red);
-  shapelist[i++] = new flip_normals(new xz_rect(213, 343, 227, 332, 554,light));
-  lightlist[l++] = new flip_normals(new xz_rect(213, 343, 227, 332, 554,light));
-  shapelist[i++] = new flip_normals(new xz_rect(0, 555, 0, 555, 555, white));
-  shapelist[i++] = new xz_rect(0, 555, 0, 555, 0, white);
-  shapelist[i++] = new flip_normals(new xy_rect(0, 555, 0, 555, 555, white));
-  shapelist[i++] = new translate(new rotate_y(new box(vec4(0, 0, 0), vec4(165, 330, 165), white),  15), vec4(265,0,295));
-  shapelist[i++] = new sphere(vec4(190, 90, 190),90 , glass);
-  lightlist[l++] = new sphere(vec4(190, 90, 190),90 , glass);
-
-  *scene = new hittable_list(shapelist,i);
-  *lightarea = new hittable_list(lightlist,l);
-
-  vec4 lookfrom(278, 278, -800);
-  vec4 lookat(278, 278, 0);
-  double dist_to_focus = 10.0;
-  double aperture = 0.0;
-  double vfov = 40.0;
-  double aspect = double(s->window_width) / double(s->window_height);
-  *view = new camera(lookfrom, lookat, vec4(0,1,0), vfov, aspect, aperture, dist_to_focus, 0.0, 1.0);
-}
-
-inline vec4 de_NaN(const vec4& c) {
-  vec4 temp = c;
-  if (!(temp[0] == temp[0])) temp[0] = 0.0;
-  if (!(temp[1] == temp[1])) temp[1] = 0.0;
-  if (!(temp[2] == temp[2])) temp[2] = 0.0;
-  return temp;
-}
-
-inline vec4 filter_NaN(const vec4& c, uint32_t& discarded_samples) {
-  if (!(c[0] == c[0])) { discarded_samples++; return vec4(0.0, 0.0, 0.0); }
-  if (!(c[1] == c[1])) { discarded_samples++; return vec4(0.0, 0.0, 0.0); }
-  if (!(c[2] == c[2])) { discarded_samples++; return vec4(0.0, 0.0, 0.0); }
-  return c;
-}
-
-inline bool check_NaN(const vec4& c) {
-  return !(c[0] == c[0]) || !(c[1] == c[1]) || !(c[2] == c[2]);
-}
-
-// Globals because I can
-
-double inv_width;
-double inv_height;
-
-vec4 color(const ray& r, hittable *world, hittable *light, int depth) {
-  hit_record hrec;
-  if (world->hit(r, 0.001, DBL_MAX, hrec)) {
-    scatter_record srec;
-    vec4 emitted = hrec.mat_ptr->emitted(r, hrec, hrec.u, hrec.v, hrec.p);
-
-    // Depth per ray
-    if (depth < 3 && hrec.mat_ptr->scatter(r, hrec, srec)) {
-      if (srec.is_specular) {
-        return srec.attenuation * color(srec.specular_ray, world, light, depth+1);
-      }
-      else {
-        hittable_pdf plight(light, hrec.p);
-        mixture_pdf p(&plight, srec.pdf_ptr);
-        ray scattered = ray(hrec.p, p.generate(), r.time());
-        double pdf_val = fmax(p.value(scattered.direction()), DBL_MIN);
-        delete srec.pdf_ptr;
-        return emitted + srec.attenuation * hrec.mat_ptr->scattering_pdf(r,hrec,scattered) * color(scattered, world, light, depth+1) / pdf_val;
-      }
-    }
-    else {
-        return emitted;
-    }
-  }
-  else {
-    double t = 0.5*((r.direction()).normalized().y + 1.0);
-    return vec4(1.0, 1.0, 1.0)*(1.0-t) + vec4(0.5, 0.7, 1.0)*t;
-    //return vec4(0.0, 0.0, 0.0);
-  }
-}
-
-inline bool update_state(uint16_t& px, uint16_t& py, uint16_t accuracy, settings* s, float* framebuffer) {
-  if (px < s->window_width - accuracy) {
-    px += accuracy;
-    if (framebuffer[(s->window_width * py + px) * 4 + 3] == 1.0) {
-      px += accuracy;
-    }
-  }
-  else if (py < s->window_height - accuracy) { px = 0; py += accuracy; }
-  else { return true; }
-  return false;
-}
-
-// THREADING
-static std::atomic<int> nWorkerComplete;
-struct WorkerThread {
-  uint16_t px = 0;
-  uint16_t py = 0;
-  uint16_t accuracy = 0;
-
-  settings* s = nullptr;
-  camera* view = nullptr;
-  hittable* world = nullptr;
-  hittable* light = nullptr;
-  float* framebuffer = nullptr;
-
-  bool alive = true;
-  std::condition_variable cvStart;
-  std::mutex mux;
-
-  std::thread thread;
-
-  void Start(uint16_t x, uint16_t y, uint16_t acc) {
-    px = x;
-    py = y;
-    accuracy = acc;
-
-    std::unique_lock<std::mutex> lm(mux);
-    cvStart.notify_one();
-  }
-
-  void render_pixel() {
-
-    while (alive) {
-      std::unique_lock<std::mutex> lm(mux);
-      cvStart.wait(lm);
-
-      framebuffer[(s->window_width * py + px) * 4 + 3] = 1.0;
-      vec4 col = vec4(0.0, 0.0, 0.0);
-      vec4 c;
-      //uint32_t discarded_samples = -1;
-      for (uint32_t samples = 0; samples < s->num_samples; samples++) {
-        do {
-          double u = double(px + random_double()) * inv_width;
-          double v = double(s->window_height - py + random_double()) * inv_height;
-
-          c = color(view->get_ray(u, v), world, light, 0);
-          //discarded_samples++;
-        } while (check_NaN(c));
-
-        //if (discarded_samples > 0) printf("Discarded %d samples\n", discarded_samples);
-        col += c;
-      }
-
-      col /= (double(s->num_samples));
-      //col *= s->inv_num_samples; Doesn't really make a difference
-      col = col.square_root();
-
-      for (int k = px; k < px + accuracy && k < s->window_width; ++k) {
-        for (int l = py; l < py + accuracy && l < s->window_height; ++l) {
-          framebuffer[(s->window_width * l + k) * 4 + 0] = col.r;
-          framebuffer[(s->window_width * l + k) * 4 + 1] = col.g;
-          framebuffer[(s->window_width * l + k) * 4 + 2] = col.b;
-          framebuffer[(s->window_width * l + k) * 4 + 3] = 0.99;
-          // Different alpha to check pixels that have already been rendered in broad passes
-        }
-      }
-      /*framebuffer[(s->window_width * py + px) * 4 + 0] = col.r;
-      framebuffer[(s->window_width * py + px) * 4 + 1] = col.g;
-      framebuffer[(s->window_width * py + px) * 4 + 2] = col.b;*/
-      framebuffer[(s->window_width * py + px) * 4 + 3] = 1.0;
-      
-      //if (update_state(px, py, accuracy, s, framebuffer)) 
-        nWorkerComplete++;
-    }
-  }
-};
-const int nMaxThreads = 32;
-WorkerThread workers[nMaxThreads];
-void cleanup_workers() {
-  for (int i = 0; i < nMaxThreads; i++)
-  {
-    workers[i].alive = false;		 // Allow thread exit
-    workers[i].cvStart.notify_one(); // Fake starting gun
-  }
-
-  // Clean up worker threads
-  for (int i = 0; i < nMaxThreads; i++)
-    workers[i].thread.join();
-
-}
-void initialize_workers(camera* view, hittable* world, hittable* light, settings* s, float* framebuffer) {
-  for (int i = 0; i < nMaxThreads; ++i) {
-    workers[i].alive = true;
-
-    workers[i].s = s;
-    workers[i].view = view;
-    workers[i].world = world;
-    workers[i].light = light;
-    workers[i].framebuffer = framebuffer;
-
-    workers[i].thread = std::thread(&WorkerThread::render_pixel, &workers[i]);
-  }
-}
-
-
-
-void render_pass(GLuint shaderProgram, GLFWwindow* window, uint16_t accuracy, camera *view, hittable *world, hittable *light, settings* s, float* framebuffer) {
-
-  uint16_t px = 0;
-  uint16_t py = 0;
-  bool done = false;
-
-  while(!glfwWindowShouldClose(window) && !done) {
-
-    nWorkerComplete = 0;
-    int nUsedWorker = 0;
-    for (int i = 0; i < nMaxThreads; ++i) {
-
-      // Assign threads to pixels
-      workers[i].Start(px, py, accuracy);
-      nUsedWorker++;
-
-      // Update next pixel to be rendered
-      if (update_state(px, py, accuracy, s, framebuffer)) { done = true; break; }
-    }
-
-    while (nWorkerComplete < nUsedWorker) // Wait for all workers to complete
-    {    }
-
-    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, s->window_width, s->window_height, GL_RGBA, GL_FLOAT, framebuffer);
-    glUseProgram(shaderProgram);
-    glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
-
-    glfwSwapBuffers(window);
-  }
-}
-
-int main(int argc, char** argv) {
-
-  srand((unsigned)time(NULL));
-  settings s = ReadSettings();
-
-  inv_width = 1.0 / double(s.window_width);
-  inv_height = 1.0 / double(s.window_height);
-
-  glfwInit();
-  glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-  glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
-  glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
-  glfwWindowHint(GLFW_RESIZABLE, GL_FALSE);
-
-  GLFWwindow* window = glfwCreateWindow(s.window_width, s.window_height, "RayTracerV2", NULL, NULL);
-  if (window == NULL) {
-    std::cout << "Failed to create GLFW window" << std::endl;
-    glfwTerminate();
-    return -1;
-  }
-  glfwMakeContextCurrent(window);
-
-  if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress))
-  {
-    std::cout << "Failed to initialize GLAD" << std::endl;
-    return -1;
-  }
-
-  glViewport(0, 0, s.window_width, s.window_height);
-
-
-  hittable *world = nullptr;
-  hittable *light = nullptr;
-  camera *view = nullptr;
-
-  switch (s.scene_index) {
-    case 0:
-      random_scene(&world,&light, &view, &s);
-      break;
-    case 1:
-      cornell_box(&world,&light, &view, &s);
-      break;
-    case 2:
-      perlin_scene(&world,&light, &view, &s);
-      break;
-    default:
-      random_scene(&world, &light, &view, &s);
-      break;
-  }
-
-  // OPENGL STUFF
-
-  float* framebuffer = (float*)calloc(4 * s.window_width * s.window_height, sizeof(float));
-
-  GLuint texture;
-  glGenTextures(1, &texture);
-  glBindTexture(GL_TEXTURE_2D, texture);
-
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, s.window_width, s.window_height, 0, GL_RGBA, GL_FLOAT, framebuffer);
-
-  const char* vertex_shader_source = {
-    "#version 330\n"
-    "layout(location = 0) in vec3 aPosition;\n"
-    "layout(location = 1) in vec2 aTexCoord;\n"
-    "out vec2 texCoord;\n"
-    "void main()\n"
-    "{\n"
-    "	gl_Position = vec4(aPosition,1.0);\n"
-    " texCoord = aTexCoord;"
-    "}\n"
-  };
-
-  const char* fragment_shader_source = {
-    "#version 330\n"
-    "out vec4 fragColor;\n"
-    "in vec2 texCoord;\n"
-    "uniform sampler2D colorTexture;\n"
-    "void main()\n"
-    "{\n"
-    "	fragColor = texture(colorTexture, texCoord);\n"
-    "}\n"
-  };
-  int vertexShader = glCreateShader(GL_VERTEX_SHADER);
-  glShaderSource(vertexShader, 1, &vertex_shader_source, NULL);
-  glCompileShader(vertexShader);
-  // check for shader compile errors
-  int success;
-  char infoLog[512];
-  glGetShaderiv(vertexShader, GL_COMPILE_STATUS, &success);
-  if (!success)
-  {
-    glGetShaderInfoLog(vertexShader, 512, NULL, infoLog);
-    std::cout << "ERROR::SHADER::VERTEX::COMPILATION_FAILED\n" << infoLog << std::endl;
-  }
-  // fragment shader
-  int fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
-  glShaderSource(fragmentShader, 1, &fragment_shader_source, NULL);
-  glCompileShader(fragmentShader);
-  // check for shader compile errors
-  glGetShaderiv(fragmentShader, GL_COMPILE_STATUS, &success);
-  if (!success)
-  {
-    glGetShaderInfoLog(fragmentShader, 512, NULL, infoLog);
-    std::cout << "ERROR::SHADER::FRAGMENT::COMPILATION_FAILED\n" << infoLog << std::endl;
-  }
-  // link shaders
-  GLuint shaderProgram = glCreateProgram();
-  glAttachShader(shaderProgram, vertexShader);
-  glAttachShader(shaderProgram, fragmentShader);
-  glLinkProgram(shaderProgram);
-  // check for linking errors
-  glGetProgramiv(shaderProgram, GL_LINK_STATUS, &success);
-  if (!success) {
-    glGetProgramInfoLog(shaderProgram, 512, NULL, infoLog);
-    std::cout << "ERROR::SHADER::PROGRAM::LINKING_FAILED\n" << infoLog << std::endl;
-  }
-  glDeleteShader(vertexShader);
-  glDeleteShader(fragmentShader);
-
-  float vertices[] = {
-    -1.0f, -1.0f, 0.0f,     0.0f, 1.0f,
-     1.0f, -1.0f, 0.0f,     1.0f, 1.0f,
-     1.0f,  1.0f, 0.0f,     1.0f, 0.0f,
-    -1.0f,  1.0f, 0.0f,     0.0f, 0.0f
-  };
-  GLuint indices[] = {
-      0, 1, 2,
-      0, 2, 3
-  };
-  GLuint VBO, VAO, EBO;
-  glGenVertexArrays(1, &VAO);
-  glGenBuffers(1, &VBO);
-  glGenBuffers(1, &EBO);
-  glBindVertexArray(VAO);
-
-  glBindBuffer(GL_ARRAY_BUFFER, VBO);
-  glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
-
-  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-  glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
-
-  glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)0);
-  glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)(3 * sizeof(float)));
-  glEnableVertexAttribArray(0);
-  glEnableVertexAttribArray(1);
-  
-
-  // NOW THE FUN STUFF BEGINS
-  initialize_workers(view, world, light, &s, framebuffer);
-
-  auto t_start = std::chrono::high_resolution_clock::now();
-  auto t_finish = std::chrono::high_resolution_clock::now();
-  if (s.progressive_render){
-    uint16_t pass_accuracy = s.window_width < s.window_height ? s.window_width : s.window_height;
-    while (pass_accuracy > 1) {
-      std::cout << "Performing broad pass " << pass_accuracy << std::endl;
-      t_start = std::chrono::high_resolution_clock::now();
-      render_pass(shaderProgram, window, pass_accuracy, view, world, light, &s, framebuffer);
-      t_finish = std::chrono::high_resolution_clock::now();
-      std::cout << "Time elapsed: " << std::chrono::duration_cast<std::chrono::milliseconds>(t_finish - t_start).count() / 1000.0 << " seconds." << std::endl;
-      pass_accuracy >>= 1;
-    }
-  }
-  std::cout << "Performing final pass" << std::endl;
-  t_start = std::chrono::high_resolution_clock::now();
-  render_pass(shaderProgram, window, 1, view, world, light, &s, framebuffer);
-  t_finish = std::chrono::high_resolution_clock::now();
-  std::cout << "Time elapsed: " << std::chrono::duration_cast<std::chrono::milliseconds>(t_finish - t_start).count() / 1000.0 << " seconds." << std::endl;
-
-  cleanup_workers();
-  getchar();
-  if (s.output_to_file) {
-    uint8_t* write_buffer = (uint8_t*)calloc(3 * s.window_width * s.window_height, sizeof(uint8_t));
-
-    for (int k = 0; k < s.window_height; ++k) {
-      for (int l = 0; l < s.window_width; ++l) {
-        write_buffer[(s.window_width * k + l) * 3 + 0] = uint8_t(fmin(framebuffer[(s.window_width * k + l) * 4 + 0], 1.0f) * 255.99f);
-        write_buffer[(s.window_width * k + l) * 3 + 1] = uint8_t(fmin(framebuffer[(s.window_width * k + l) * 4 + 1], 1.0f) * 255.99f);
-        write_buffer[(s.window_width * k + l) * 3 + 2] = uint8_t(fmin(framebuffer[(s.window_width * k + l) * 4 + 2], 1.0f) * 255.99f);
-      }
-    }
-    stbi_write_png("../data/render.png", s.window_width, s.window_height, 3, write_buffer, 3 * s.window_width);
-    free(write_buffer);
-  }
-  free(framebuffer);
-  getchar();
-  glfwTerminate();
-  return 0;
+/* Author: Diego Cosin <cosinma@esat-alumni.com>. */
+
+#define _CRT_SECURE_NO_WARNINGS
+#include <stdlib.h>
+#include <string.h>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <time.h>
+#include <new>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <atomic>
+#include <chrono>
+#include "float.h"
+#include "random.h"
+#include "camera.h"
+#include "settings.h"
+// #include "constant_medium.h"
+#include "dispatch.h"
+#include "animation.h"
+#include "scenes.h"
+#include "integrator.h"
+#include "stats.h"
+#include "heatmap.h"
+#include "trace.h"
+#include "aov.h"
+#include "denoise.h"
+#include "numa.h"
+#include "framebuffer.h"
+
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+#define STB_IMAGE_IMPLEMENTATION
+#include <stb/stb_image.h>
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include <stb/stb_image_write.h>
+
+// Moves (px, py) on to the start of the next run, true past the last one
+inline bool next_run(uint16_t& px, uint16_t& py, uint16_t accuracy, settings* s) {
+  px += run_width(px, accuracy, s->window_width);
+  if (px < s->window_width) return false;
+  px = 0;
+  py += accuracy;
+  return py >= s->window_height;
+}
+
+// THREADING
+static std::atomic<int> nWorkerComplete;
+// Padded to whole cache lines, so starting one worker doesn't take the line
+// of its neighbour's state away from it
+struct alignas(kCacheLine) WorkerThread {
+  int index = 0;
+  uint16_t px = 0;
+  uint16_t py = 0;
+  uint16_t accuracy = 0;
+
+  settings* s = nullptr;
+  camera* view = nullptr;
+  hittable* world = nullptr;
+  hittable* light = nullptr;
+  float* framebuffer = nullptr;
+  uint8_t* rendered = nullptr;
+  aov_buffer* aovs = nullptr;
+  float* costbuffer = nullptr;
+  heatmap_mode heatmap = heatmap_off;
+  affinity_mode affinity = affinity_none;
+
+  bool alive = true;
+  bool started = false;
+  // Work other than a run, see Run()
+  const std::function<void(int)>* task = nullptr;
+  std::condition_variable cvStart;
+  std::mutex mux;
+
+  std::thread thread;
+  pixel_run run;
+  value_run<uint8_t> run_rendered;
+  value_run<float> run_cost;
+  aov_run run_aovs;
+
+  void Start(uint16_t x, uint16_t y, uint16_t acc) {
+    std::unique_lock<std::mutex> lm(mux);
+    px = x;
+    py = y;
+    accuracy = acc;
+    started = true;
+    cvStart.notify_one();
+  }
+
+  // Has the thread call body(index) instead of rendering a run; 'body' has
+  // to outlive it, which the caller waiting on nWorkerComplete ensures
+  void Run(const std::function<void(int)>& body) {
+    std::unique_lock<std::mutex> lm(mux);
+    task = &body;
+    started = true;
+    cvStart.notify_one();
+  }
+
+  // Renders the run of pixels starting at the one given to Start(), or set
+  // directly by a single-threaded render, and copies it into the
+  // framebuffer. 'rendered' marks the pixels an earlier, broader pass
+  // already sampled; they keep what is there. Every block of the run is
+  // written, so the first pass is the first write to the framebuffer. The
+  // flags, costs and AOVs of row py are staged the same way.
+  void render_run() {
+    TRACE_SCOPE("run", "render", "x", px, "y", py);
+
+    int width = run_width(px, accuracy, s->window_width);
+    int y1 = py + accuracy < s->window_height ? py + accuracy : s->window_height;
+    uint8_t* rendered_row = rendered + size_t(s->window_width) * py;
+    float* cost_row = costbuffer != nullptr ? costbuffer + size_t(s->window_width) * py : nullptr;
+    run.begin(px, width, 4);
+    run_rendered.load(rendered_row, px, width);
+    if (cost_row != nullptr) run_cost.load(cost_row, px, width);
+    run_aovs.load(*aovs, px, py, width);
+    bool want_features = aovs->mask != aov_bit(aov_beauty);
+    for (int x = px; x < px + width; x += accuracy) {
+      if (run_rendered.at(x)) {
+        memcpy(run.at(x), &framebuffer[(s->window_width * py + x) * 4], 4 * sizeof(float));
+        run.fill(x + 1, accuracy - 1, run.at(x));
+        continue;
+      }
+      cost_probe probe(heatmap);
+      pixel_features pf;
+      vec4 col = sample_pixel(view, world, light, x, py, s, want_features ? &pf : nullptr);
+      if (cost_row != nullptr)
+        run_cost.at(x) = probe.cost();
+      run_aovs.store(x, col * col, pf);
+
+      float rgba[4] = { float(col.r), float(col.g), float(col.b), 1.0f };
+      run.fill(x, accuracy, rgba);
+      run_rendered.at(x) = 1;
+    }
+    run.flush(framebuffer, s->window_width, py, y1);
+    run_rendered.flush(rendered_row);
+    if (cost_row != nullptr) run_cost.flush(cost_row);
+    run_aovs.flush(*aovs);
+    nWorkerComplete++;
+  }
+
+  void render_pixel() {
+    trace_thread_name("worker " + std::to_string(index));
+    pin_current_thread(index, affinity);
+    seed_random(s->seed * 2654435761u + uint32_t(index) + 1u);
+
+    while (true) {
+      std::unique_lock<std::mutex> lm(mux);
+      // A start that came before we waited is not lost
+      cvStart.wait(lm, [this]() { return started || !alive; });
+      if (!alive) break;
+      started = false;
+      if (task != nullptr) {
+        const std::function<void(int)>* body = task;
+        task = nullptr;
+        lm.unlock();
+        (*body)(index);
+        nWorkerComplete++;
+        continue;
+      }
+      render_run();
+    }
+  }
+};
+// One worker per render thread, each handed a run of pixels (framebuffer.h)
+// at a time. A single-threaded render starts no threads and runs workers[0]
+// on the main thread, so profiles show the plain call stack.
+int nWorkers = 0;
+WorkerThread* workers = nullptr;
+void cleanup_workers() {
+  for (int i = 0; i < nWorkers; i++)
+  {
+    std::unique_lock<std::mutex> lm(workers[i].mux);
+    workers[i].alive = false;		 // Allow thread exit
+    workers[i].cvStart.notify_one(); // Fake starting gun
+  }
+
+  // Clean up worker threads
+  for (int i = 0; i < nWorkers; i++)
+    if (workers[i].thread.joinable()) workers[i].thread.join();
+
+  for (int i = 0; i < nWorkers; i++) workers[i].~WorkerThread();
+  _mm_free(workers);
+  workers = nullptr;
+  nWorkers = 0;
+}
+void initialize_workers(const scene_replicas& scenes, settings* s, float* framebuffer, uint8_t* rendered, aov_buffer* aovs, float* costbuffer, heatmap_mode heatmap) {
+  nWorkers = RenderThreads(*s);
+  // Aligned by hand, new[] ignores alignas before C++17
+  workers = (WorkerThread*)_mm_malloc(nWorkers * sizeof(WorkerThread), kCacheLine);
+  for (int i = 0; i < nWorkers; ++i) ::new (&workers[i]) WorkerThread();
+  affinity_mode affinity = thread_affinity(*s);
+  std::cout << "Rendering with " << nWorkers << (nWorkers == 1 ? " thread" : " threads") << std::endl;
+  for (int i = 0; i < nWorkers; ++i) {
+    workers[i].index = i;
+    workers[i].alive = true;
+
+    // Each worker traces the copy of the scene on its own node
+    const scene_instance& scene = scenes.for_thread(i, affinity);
+    workers[i].s = s;
+    workers[i].view = scene.view;
+    workers[i].world = scene.world;
+    workers[i].light = scene.light;
+    workers[i].framebuffer = framebuffer;
+    workers[i].rendered = rendered;
+    workers[i].aovs = aovs;
+    workers[i].costbuffer = costbuffer;
+    workers[i].heatmap = heatmap;
+    workers[i].affinity = affinity;
+
+    if (nWorkers > 1)
+      workers[i].thread = std::thread(&WorkerThread::render_pixel, &workers[i]);
+  }
+  // A single worker is this thread, pinned only while it renders a pass
+  if (nWorkers == 1)
+    seed_random(s->seed * 2654435761u + 1u);
+}
+
+
+
+// Headless renders have no window and skip this
+void present(GLuint shaderProgram, GLFWwindow* window, settings* s, float* framebuffer) {
+  if (window == nullptr) return;
+  TRACE_SCOPE("present", "display");
+  glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, s->window_width, s->window_height, GL_RGBA, GL_FLOAT, framebuffer);
+  glUseProgram(shaderProgram);
+  glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
+
+  glfwSwapBuffers(window);
+}
+
+// Returns the rows the pass got through: all of them, unless the window was
+// closed first
+int render_pass(GLuint shaderProgram, GLFWwindow* window, uint16_t accuracy, settings* s, float* framebuffer) {
+
+  TRACE_SCOPE("pass", "render", "accuracy", accuracy);
+  uint16_t px = 0;
+  uint16_t py = 0;
+  bool done = false;
+  scoped_pin pin(0, nWorkers == 1 ? workers[0].affinity : affinity_none);
+
+  while((window == nullptr || !glfwWindowShouldClose(window)) && !done) {
+
+    nWorkerComplete = 0;
+    int nUsedWorker = 0;
+    for (int i = 0; i < nWorkers; ++i) {
+
+      // Assign threads to runs
+      if (nWorkers > 1) {
+        workers[i].Start(px, py, accuracy);
+      }
+      else {
+        workers[i].px = px;
+        workers[i].py = py;
+        workers[i].accuracy = accuracy;
+        workers[i].render_run();
+      }
+      nUsedWorker++;
+
+      // Update next run to be rendered
+      if (next_run(px, py, accuracy, s)) { done = true; break; }
+    }
+
+    {
+      TRACE_SCOPE("barrier wait", "sync", "workers", nUsedWorker);
+      while (nWorkerComplete < nUsedWorker) // Wait for all workers to complete
+      {    }
+    }
+
+    present(shaderProgram, window, s, framebuffer);
+  }
+  return done ? s->window_height : py;
+}
+
+// The framebuffer isn't cleared up front (see new_framebuffer); when the
+// first pass of a frame is cut short, the rows it never got to are
+void clear_unrendered_rows(settings* s, float* framebuffer, int rows) {
+  if (rows < s->window_height)
+    memset(framebuffer + size_t(s->window_width) * rows * 4, 0, size_t(s->window_width) * (s->window_height - rows) * 4 * sizeof(float));
+}
+
+// Time-budgeted rendering: passes over the whole image, each adding a few
+// samples to every pixel, until s->time_budget seconds are up, so the image
+// gets as many samples as the budget allows whatever the scene. Passes start
+// at one sample per pixel for a quick first look and double up to
+// kSampleBlock; pass p draws from block p of accumulate_pixel, so a budget
+// render is reproducible up to where the clock stopped it. Rows are handed
+// out to the threads as they come free, and the clock is checked before
+// each one, so the last pass may leave some pixels a pass behind (see the
+// sample_count AOV). Passes also stop at kAccumMaxSamples per pixel, where
+// the fixed point sums would overflow.
+//
+// With s->budget_reference set, the result is compared to that converged
+// PFM and the errors written to <output>_budget.json with the sample counts,
+// so two samplers or integrators can be compared at equal time.
+void render_budget(GLuint shaderProgram, GLFWwindow* window, const scene_replicas& scenes, settings* s, float* framebuffer, aov_buffer* aovs) {
+  TRACE_SCOPE("time budget", "render");
+  int width = s->window_width, height = s->window_height;
+  if (s->denoise || (aovs->mask & ~(aov_bit(aov_beauty) | aov_bit(aov_sample_count))) != 0)
+    std::cout << "Time-budgeted renders only fill the beauty and sample_count AOVs" << std::endl;
+  affinity_mode affinity = thread_affinity(*s);
+
+  std::vector<pixel_accum> accum(size_t(width) * height);
+  memset(accum.data(), 0, accum.size() * sizeof(pixel_accum));
+  auto start = std::chrono::steady_clock::now();
+  auto deadline = start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(s->time_budget));
+  std::atomic<bool> expired(false);
+  int passes = 0, drawn = 0;
+  for (int per_pass = 1; !expired && drawn + per_pass <= kAccumMaxSamples && (window == nullptr || !glfwWindowShouldClose(window)); ++passes) {
+    TRACE_SCOPE("pass", "render", "samples", per_pass);
+    std::atomic<int> next_row(0);
+    std::function<void(int)> worker = [&](int index) {
+      const scene_instance& scene = scenes.for_thread(index, affinity);
+      for (int y = next_row++; y < height; y = next_row++) {
+        if (std::chrono::steady_clock::now() >= deadline) {
+          expired = true;
+          break;
+        }
+        for (int x = 0; x < width; ++x)
+          accumulate_pixel(scene.view, scene.world, scene.light, x, y, s, s->seed, passes * kSampleBlock, per_pass, accum[size_t(width) * y + x]);
+      }
+    };
+    // On the render workers, which stay up (and pinned) between passes
+    if (nWorkers == 1) {
+      scoped_pin pin(0, affinity);
+      worker(0);
+    }
+    else {
+      nWorkerComplete = 0;
+      for (int i = 0; i < nWorkers; ++i) workers[i].Run(worker);
+      TRACE_SCOPE("barrier wait", "sync", "workers", nWorkers);
+      while (nWorkerComplete < nWorkers) // Wait for all workers to complete
+      {    }
+    }
+
+    for (size_t i = 0; i < accum.size(); ++i) {
+      vec4 col = resolve_accum(accum[i]).square_root();
+      framebuffer[i * 4 + 0] = float(col.r);
+      framebuffer[i * 4 + 1] = float(col.g);
+      framebuffer[i * 4 + 2] = float(col.b);
+      framebuffer[i * 4 + 3] = 1.0f;
+    }
+    present(shaderProgram, window, s, framebuffer);
+    drawn += per_pass;
+    per_pass = per_pass * 2 < kSampleBlock ? per_pass * 2 : kSampleBlock;
+  }
+  double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  uint32_t min_samples = UINT32_MAX, max_samples = 0;
+  double total_samples = 0.0;
+  for (int y = 0; y < height; ++y) {
+    for (int x = 0; x < width; ++x) {
+      const pixel_accum& a = accum[size_t(width) * y + x];
+      pixel_features pf;
+      pf.samples = int(a.samples);
+      aovs->store(x, y, resolve_accum(a), pf);
+      min_samples = a.samples < min_samples ? a.samples : min_samples;
+      max_samples = a.samples > max_samples ? a.samples : max_samples;
+      total_samples += a.samples;
+    }
+  }
+  double mean_samples = total_samples / (double(width) * height);
+  std::cout << passes << " passes in " << elapsed << " seconds, " << mean_samples << " samples per pixel (" << min_samples << "-" << max_samples << ")" << std::endl;
+
+  if (s->budget_reference.empty()) return;
+  std::vector<float> reference;
+  int ref_width, ref_height, ref_components;
+  if (!read_pfm(s->budget_reference.c_str(), reference, ref_width, ref_height, ref_components) ||
+      ref_width != width || ref_height != height || ref_components != 3) {
+    std::cout << "Could not read a " << width << "x" << height << " RGB reference from " << s->budget_reference << std::endl;
+    return;
+  }
+  // relMSE divides by the reference squared, offset so black pixels count
+  double squared_error = 0.0, relative_error = 0.0;
+  for (int y = 0; y < height; ++y) {
+    for (int x = 0; x < width; ++x) {
+      const float* value = aovs->at(aov_beauty, x, y);
+      const float* ref = &reference[(size_t(width) * y + x) * 3];
+      for (int c = 0; c < 3; ++c) {
+        double d = double(value[c]) - ref[c];
+        squared_error += d * d;
+        relative_error += d * d / (double(ref[c]) * ref[c] + 0.01);
+      }
+    }
+  }
+  double count = 3.0 * width * height;
+  std::string report = s->output + "_budget.json";
+  FILE* f = fopen(report.c_str(), "w");
+  if (f == nullptr) {
+    std::cout << "Could not write " << report << std::endl;
+    return;
+  }
+  fprintf(f, "{\n");
+  fprintf(f, "  \"budget_seconds\": %.3f,\n", s->time_budget);
+  fprintf(f, "  \"elapsed_seconds\": %.3f,\n", elapsed);
+  fprintf(f, "  \"passes\": %d,\n", passes);
+  fprintf(f, "  \"samples_min\": %u,\n", min_samples);
+  fprintf(f, "  \"samples_mean\": %.2f,\n", mean_samples);
+  fprintf(f, "  \"samples_max\": %u,\n", max_samples);
+  fprintf(f, "  \"rmse\": %.6g,\n", sqrt(squared_error / count));
+  fprintf(f, "  \"relmse\": %.6g\n", relative_error / count);
+  fprintf(f, "}\n");
+  fclose(f);
+  std::cout << "RMSE " << sqrt(squared_error / count) << ", relMSE " << relative_error / count << " against " << s->budget_reference << std::endl;
+}
+
+void render_frame(GLuint shaderProgram, GLFWwindow* window, const scene_replicas& scenes, settings* s, float* framebuffer, const uint8_t* rendered, aov_buffer* aovs) {
+  if (s->time_budget > 0.0) {
+    render_budget(shaderProgram, window, scenes, s, framebuffer, aovs);
+    return;
+  }
+  auto t_start = std::chrono::high_resolution_clock::now();
+  auto t_finish = std::chrono::high_resolution_clock::now();
+  bool first_pass = true;
+  if (s->progressive_render){
+    uint16_t pass_accuracy = s->window_width < s->window_height ? s->window_width : s->window_height;
+    while (pass_accuracy > 1) {
+      std::cout << "Performing broad pass " << pass_accuracy << std::endl;
+      t_start = std::chrono::high_resolution_clock::now();
+      int rows = render_pass(shaderProgram, window, pass_accuracy, s, framebuffer);
+      if (first_pass) clear_unrendered_rows(s, framebuffer, rows);
+      first_pass = false;
+      t_finish = std::chrono::high_resolution_clock::now();
+      std::cout << "Time elapsed: " << std::chrono::duration_cast<std::chrono::milliseconds>(t_finish - t_start).count() / 1000.0 << " seconds." << std::endl;
+      pass_accuracy >>= 1;
+    }
+  }
+  std::cout << "Performing final pass" << std::endl;
+  t_start = std::chrono::high_resolution_clock::now();
+  int rows = render_pass(shaderProgram, window, 1, s, framebuffer);
+  if (first_pass) clear_unrendered_rows(s, framebuffer, rows);
+  t_finish = std::chrono::high_resolution_clock::now();
+  std::cout << "Time elapsed: " << std::chrono::duration_cast<std::chrono::milliseconds>(t_finish - t_start).count() / 1000.0 << " seconds." << std::endl;
+
+  if (s->denoise) {
+    TRACE_SCOPE("denoise", "render");
+    denoise_params params;
+    params.iterations = s->denoise_iterations;
+    t_start = std::chrono::high_resolution_clock::now();
+    denoise(framebuffer, 4, feature_buffers(*aovs), params);
+    // The float outputs are written from the beauty AOV, keep it in step
+    for (int y = 0; y < s->window_height; ++y) {
+      for (int x = 0; x < s->window_width; ++x) {
+        float* beauty = aovs->at(aov_beauty, x, y);
+        const float* shown = &framebuffer[(s->window_width * y + x) * 4];
+        for (int c = 0; c < 3; ++c) beauty[c] = shown[c] * shown[c];
+      }
+    }
+    t_finish = std::chrono::high_resolution_clock::now();
+    std::cout << "Denoised in " << std::chrono::duration_cast<std::chrono::microseconds>(t_finish - t_start).count() / 1000.0 << " ms." << std::endl;
+    present(shaderProgram, window, s, framebuffer);
+  }
+}
+
+static void write_to_file(void* context, void* data, int size) {
+  fwrite(data, 1, size_t(size), (FILE*)context);
+}
+
+bool write_png(const char* path, settings* s, float* framebuffer) {
+  uint8_t* write_buffer = (uint8_t*)calloc(3 * s->window_width * s->window_height, sizeof(uint8_t));
+
+  for (int k = 0; k < s->window_height; ++k) {
+    for (int l = 0; l < s->window_width; ++l) {
+      write_buffer[(s->window_width * k + l) * 3 + 0] = uint8_t(fmin(framebuffer[(s->window_width * k + l) * 4 + 0], 1.0f) * 255.99f);
+      write_buffer[(s->window_width * k + l) * 3 + 1] = uint8_t(fmin(framebuffer[(s->window_width * k + l) * 4 + 1], 1.0f) * 255.99f);
+      write_buffer[(s->window_width * k + l) * 3 + 2] = uint8_t(fmin(framebuffer[(s->window_width * k + l) * 4 + 2], 1.0f) * 255.99f);
+    }
+  }
+  // stbi_write_png drops fwrite and fclose errors, so the file is ours.
+  bool ok = false;
+  FILE* f = fopen(path, "wb");
+  if (f != nullptr) {
+    ok = stbi_write_png_to_func(write_to_file, f, s->window_width, s->window_height, 3, write_buffer, 3 * s->window_width) != 0;
+    ok = ferror(f) == 0 && ok;
+    ok = fclose(f) == 0 && ok;
+  }
+  free(write_buffer);
+  return ok;
+}
+
+exr_options make_exr_options(settings* s) {
+  exr_options opt;
+  opt.pixel_type = s->exr_pixel_type == "float" ? exr_float : exr_half;
+  opt.compression = s->exr_compression == "none" ? exr_no_compression : (s->exr_compression == "zips" ? exr_zips : exr_zip);
+  opt.tiled = s->exr_tiled;
+  return opt;
+}
+
+// Writes <base>.png (8 bit, clipped, plus the AOVs as PFM), <base>_<aov>.pfm
+// or <base>.exr with every AOV in it. The float formats keep the linear HDR
+// values of the beauty AOV. False, after saying so, if a file couldn't be
+// written.
+bool write_output(const std::string& base, settings* s, float* framebuffer, const aov_buffer& aovs) {
+  bool ok;
+  if (s->output_format == "exr") {
+    ok = write_aovs_exr((base + ".exr").c_str(), aovs, make_exr_options(s));
+  }
+  else if (s->output_format == "pfm") {
+    ok = write_aovs(base.c_str(), aovs);
+  }
+  else {
+    ok = write_png((base + ".png").c_str(), s, framebuffer);
+    if (!s->aovs.empty())
+      ok = write_aovs(base.c_str(), aovs) && ok;
+  }
+  if (!ok) std::cout << "Could not write " << base << "." << s->output_format << std::endl;
+  return ok;
+}
+
+// Encodes finished frames on its own thread, so writing frame k overlaps
+// with rendering frame k+1. Keeps a private copy of the framebuffer and AOVs.
+struct frame_writer {
+  std::thread thread;
+  float* buffer = nullptr;
+  aov_buffer* aovs = nullptr;
+  bool failed = false;  // Some frame couldn't be written, read after finish()
+
+  void submit(const char* base, settings* s, const float* framebuffer, const aov_buffer& frame_aovs) {
+    finish();
+    size_t size = 4 * s->window_width * s->window_height * sizeof(float);
+    if (buffer == nullptr) buffer = (float*)malloc(size);
+    memcpy(buffer, framebuffer, size);
+    if (aovs == nullptr) aovs = new aov_buffer(frame_aovs);
+    else *aovs = frame_aovs;
+    std::string name(base);
+    thread = std::thread([this, name, s]() {
+      trace_thread_name("encoder");
+      STAT_TIMER(stage_output);
+      TRACE_SCOPE("write output", "output");
+      if (!write_output(name, s, buffer, *aovs)) failed = true;
+    });
+  }
+
+  void finish() {
+    if (thread.joinable()) thread.join();
+  }
+
+  ~frame_writer() {
+    finish();
+    free(buffer);
+    delete aovs;
+  }
+};
+
+// Opens the window and sets up a textured quad for present() to show the
+// framebuffer on; nullptr if there is no display to open.
+GLFWwindow* open_display(settings* s, GLuint* shader_program) {
+  glfwInit();
+  glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+  glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+  glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+  glfwWindowHint(GLFW_RESIZABLE, GL_FALSE);
+
+  GLFWwindow* window = glfwCreateWindow(s->window_width, s->window_height, "RayTracerV2", NULL, NULL);
+  if (window == NULL) {
+    std::cout << "Failed to create GLFW window" << std::endl;
+    glfwTerminate();
+    return nullptr;
+  }
+  glfwMakeContextCurrent(window);
+
+  if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress))
+  {
+    std::cout << "Failed to initialize GLAD" << std::endl;
+    return nullptr;
+  }
+
+  glViewport(0, 0, s->window_width, s->window_height);
+
+  GLuint texture;
+  glGenTextures(1, &texture);
+  glBindTexture(GL_TEXTURE_2D, texture);
+
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+  // Filled by present(); the framebuffer holds nothing yet
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, s->window_width, s->window_height, 0, GL_RGBA, GL_FLOAT, nullptr);
+
+  const char* vertex_shader_source = {
+    "#version 330\n"
+    "layout(location = 0) in vec3 aPosition;\n"
+    "layout(location = 1) in vec2 aTexCoord;\n"
+    "out vec2 texCoord;\n"
+    "void main()\n"
+    "{\n"
+    "	gl_Position = vec4(aPosition,1.0);\n"
+    " texCoord = aTexCoord;"
+    "}\n"
+  };
+
+  const char* fragment_shader_source = {
+    "#version 330\n"
+    "out vec4 fragColor;\n"
+    "in vec2 texCoord;\n"
+    "uniform sampler2D colorTexture;\n"
+    "void main()\n"
+    "{\n"
+    "	fragColor = texture(colorTexture, texCoord);\n"
+    "}\n"
+  };
+  int vertexShader = glCreateShader(GL_VERTEX_SHADER);
+  glShaderSource(vertexShader, 1, &vertex_shader_source, NULL);
+  glCompileShader(vertexShader);
+  // check for shader compile errors
+  int success;
+  char infoLog[512];
+  glGetShaderiv(vertexShader, GL_COMPILE_STATUS, &success);
+  if (!success)
+  {
+    glGetShaderInfoLog(vertexShader, 512, NULL, infoLog);
+    std::cout << "ERROR::SHADER::VERTEX::COMPILATION_FAILED\n" << infoLog << std::endl;
+  }
+  // fragment shader
+  int fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
+  glShaderSource(fragmentShader, 1, &fragment_shader_source, NULL);
+  glCompileShader(fragmentShader);
+  // check for shader compile errors
+  glGetShaderiv(fragmentShader, GL_COMPILE_STATUS, &success);
+  if (!success)
+  {
+    glGetShaderInfoLog(fragmentShader, 512, NULL, infoLog);
+    std::cout << "ERROR::SHADER::FRAGMENT::COMPILATION_FAILED\n" << infoLog << std::endl;
+  }
+  // link shaders
+  GLuint shaderProgram = glCreateProgram();
+  glAttachShader(shaderProgram, vertexShader);
+  glAttachShader(shaderProgram, fragmentShader);
+  glLinkProgram(shaderProgram);
+  // check for linking errors
+  glGetProgramiv(shaderProgram, GL_LINK_STATUS, &success);
+  if (!success) {
+    glGetProgramInfoLog(shaderProgram, 512, NULL, infoLog);
+    std::cout << "ERROR::SHADER::PROGRAM::LINKING_FAILED\n" << infoLog << std::endl;
+  }
+  glDeleteShader(vertexShader);
+  glDeleteShader(fragmentShader);
+
+  float vertices[] = {
+    -1.0f, -1.0f, 0.0f,     0.0f, 1.0f,
+     1.0f, -1.0f, 0.0f,     1.0f, 1.0f,
+     1.0f,  1.0f, 0.0f,     1.0f, 0.0f,
+    -1.0f,  1.0f, 0.0f,     0.0f, 0.0f
+  };
+  GLuint indices[] = {
+      0, 1, 2,
+      0, 2, 3
+  };
+  GLuint VBO, VAO, EBO;
+  glGenVertexArrays(1, &VAO);
+  glGenBuffers(1, &VBO);
+  glGenBuffers(1, &EBO);
+  glBindVertexArray(VAO);
+
+  glBindBuffer(GL_ARRAY_BUFFER, VBO);
+  glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
+
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+  glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
+
+  glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)0);
+  glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)(3 * sizeof(float)));
+  glEnableVertexAttribArray(0);
+  glEnableVertexAttribArray(1);
+
+  *shader_program = shaderProgram;
+  return window;
+}
+
+int main(int argc, char** argv) {
+
+  srand((unsigned)time(NULL));
+  settings s = ReadSettings(SettingsPath(argc, argv));
+  if (!ParseCommandLine(s, argc, argv)) return 1;
+  if (!s.trace.empty())
+    trace_start();
+  trace_thread_name("main");
+
+  scene_replicas scenes;
+  {
+    STAT_TIMER(stage_scene_build);
+    build_scene_replicas(s.scene_index, &s, s.seed, s.numa, scenes);
+  }
+  if (scenes.copies.size() > 1)
+    std::cout << "Scene copied to " << scenes.copies.size() << " NUMA nodes" << std::endl;
+
+  float* framebuffer = new_framebuffer(s.window_width, s.window_height, 4);
+
+  // OPENGL STUFF
+
+  GLFWwindow* window = nullptr;
+  GLuint shaderProgram = 0;
+  if (!s.headless) {
+    window = open_display(&s, &shaderProgram);
+    if (window == nullptr) return -1;
+  }
+  
+
+  heatmap_mode heatmap = parse_heatmap_mode(s.heatmap);
+  if (heatmap != heatmap_off && heatmap != heatmap_time && !RT_STATS) {
+    std::cout << "Heatmap '" << s.heatmap << "' needs a build with RT_STATS=1, recording time instead" << std::endl;
+    heatmap = heatmap_time;
+  }
+  // Aligned like the framebuffer, so the workers' runs share no lines
+  std::vector<float, cache_aligned_allocator<float>> costs(heatmap != heatmap_off ? size_t(s.window_width) * s.window_height : 0);
+  std::vector<uint8_t, cache_aligned_allocator<uint8_t>> rendered_flags(size_t(s.window_width) * s.window_height);
+  float* costbuffer = costs.empty() ? nullptr : costs.data();
+  uint8_t* rendered = rendered_flags.data();
+  aov_buffer aovs(s.window_width, s.window_height, parse_aov_list(s.aovs) | (s.denoise ? denoise_aovs : 0u));
+
+  // NOW THE FUN STUFF BEGINS
+  bool written = true;
+  initialize_workers(scenes, &s, framebuffer, rendered, &aovs, costbuffer, heatmap);
+
+  if (s.frames <= 1) {
+    {
+      TRACE_SCOPE("frame", "frame", "index", 0);
+      render_frame(shaderProgram, window, scenes, &s, framebuffer, rendered, &aovs);
+    }
+    cleanup_workers();
+    if (window != nullptr) getchar();
+    if (s.output_to_file) {
+      STAT_TIMER(stage_output);
+      TRACE_SCOPE("write output", "output");
+      written = write_output(s.output, &s, framebuffer, aovs);
+    }
+    if (costbuffer != nullptr) {
+      STAT_TIMER(stage_output);
+      TRACE_SCOPE("write heatmap", "output");
+      write_heatmap((s.output + "_heatmap").c_str(), costbuffer, s.window_width, s.window_height);
+    }
+#if RT_STATS
+    print_stats(stdout, gather_stats());
+#endif
+  }
+  else {
+    char path[1024];
+    frame_writer writer;
+    for (int frame = 0; frame < s.frames && (window == nullptr || !glfwWindowShouldClose(window)); ++frame) {
+      TRACE_SCOPE("frame", "frame", "index", frame);
+      std::cout << "Frame " << frame + 1 << "/" << s.frames << std::endl;
+      memset(rendered, 0, s.window_width * s.window_height * sizeof(uint8_t));
+
+      auto t_start = std::chrono::high_resolution_clock::now();
+      bool rebuilt;
+      {
+        STAT_TIMER(stage_bvh_update);
+        TRACE_SCOPE("animation update", "bvh", "frame", frame);
+        rebuilt = scenes.apply(double(frame) / double(s.frames));
+      }
+      auto t_finish = std::chrono::high_resolution_clock::now();
+      std::cout << (rebuilt ? "BVH rebuilt in " : "BVH refit in ") << std::chrono::duration_cast<std::chrono::microseconds>(t_finish - t_start).count() / 1000.0 << " ms." << std::endl;
+
+      render_frame(shaderProgram, window, scenes, &s, framebuffer, rendered, &aovs);
+      // The encoder thread times the write itself
+      if (s.output_to_file) {
+        snprintf(path, sizeof(path), "%s_%04d", s.output.c_str(), frame);
+        writer.submit(path, &s, framebuffer, aovs);
+      }
+      if (costbuffer != nullptr) {
+        STAT_TIMER(stage_output);
+        TRACE_SCOPE("write heatmap", "output");
+        snprintf(path, sizeof(path), "%s_%04d_heatmap", s.output.c_str(), frame);
+        write_heatmap(path, costbuffer, s.window_width, s.window_height);
+      }
+    }
+    writer.finish();
+    written = !writer.failed;
+    cleanup_workers();
+#if RT_STATS
+    print_stats(stdout, gather_stats());
+#endif
+  }
+  if (!s.trace.empty()) {
+    trace_stop();
+    if (trace_write(s.trace.c_str()))
+      std::cout << "Trace written to " << s.trace << std::endl;
+    else
+      std::cout << "Could not write trace " << s.trace << std::endl;
+  }
+  free_framebuffer(framebuffer);
+  if (window != nullptr) {
+    getchar();
+    glfwTerminate();
+  }
+  return written ? 0 : 1;
 }
\ No newline at end of file
@@ -0,0 +1,710 @@
+/* Author: Diego Cosin <cosinma@esat-alumni.com>. */
+
+// Headless renderer for images too large for the viewer. Renders the scene
+// from settings.ini in square tiles on a pool of threads and streams every
+// finished tile into a tiled OpenEXR, so memory holds one tile per thread
+// and the EXR offset table, whatever the resolution.
+//
+// Tiles are handed out dynamically, but the generator is reseeded from the
+// seed, the pixel and the block of samples (see accumulate_pixel), so the
+// image only depends on the settings, never on the thread count or
+// scheduling.
+//
+// Usage: RayTracerBatch [--option ...]
+//   The options of settings.h (--spp, --threads, --output...), which write
+//   <output>.exr, and these of its own (batch_options):
+//   --checkpoint 60  seconds between checkpoints (<output>.exr.ckpt), 0
+//                    disables
+//   --resume         continue from the checkpoint with the settings saved in
+//                    it
+//   --serve <port>   coordinate a render farm: hand tiles out to the workers
+//                    that connect and write what they send back; renders no
+//                    tiles itself unless --threads says so
+//   --timeout 600    seconds a worker may take to send anything back before
+//                    its tiles go to the others, 0 waits forever
+//   --connect host:port  work for a coordinator; the job (scene, size, spp,
+//                    seed...) comes from it, only --threads, --affinity and
+//                    --numa apply
+//   --samples first:count  render only these samples of every pixel into
+//                    <output>_<first>.acc
+//   --merge a.acc,b.acc,...  add up partial renders into <output>.exr
+//
+// A worker opens one connection per thread and renders the tiles it is sent
+// with the same per-pixel seeds, so a farm writes the same file as a single
+// process. Tiles held by a worker that drops are handed to the others.
+//
+// Sample splitting is the other way to spread a render: independent runs
+// render disjoint sample ranges of the same job and the merge adds them up.
+// The ranges have to start on a multiple of kSampleBlock and together cover
+// 0 to spp; the merged beauty is bitwise identical to a plain render of the
+// job, however the samples were split. spp can't go past 2047, where the
+// fixed point sums would overflow. A merge writes beauty
+// and, if asked for, sample_count; the other AOVs need the full samples.
+//
+// With --numa every NUMA node renders from its own copy of the scene, see
+// numa.h; the copies are identical, so the file is too.
+//
+// The EXR pixel type, compression and AOVs come from settings.ini. The
+// denoiser needs neighbouring tiles and is not run here.
+
+#define _CRT_SECURE_NO_WARNINGS
+#include <limits.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <algorithm>
+#include "net.h"
+#include "settings.h"
+#include "scenes.h"
+#include "integrator.h"
+#include "aov.h"
+#include "checkpoint.h"
+#include "accumulation.h"
+#include "numa.h"
+
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include <stb/stb_image_write.h>
+
+struct batch_config {
+  const char* out = nullptr;
+  int tile = 64;
+  int threads = 0;
+  uint32_t seed = 1;
+  double checkpoint_seconds = 60.0;
+  bool resume = false;
+  int serve_port = 0;
+  int worker_timeout = 600;  // Seconds a farm worker may stay silent
+  const char* coordinator = nullptr;
+  int first_sample = 0;
+  int sample_count = 0;   // Renders a partial when positive
+  const char* merge = nullptr;
+  affinity_mode affinity = affinity_none;
+  bool numa = false;
+};
+
+// Render thread 'index', pinned as configured; body(index) is run on it
+template <typename F>
+std::thread render_thread(const batch_config& config, int index, F body) {
+  affinity_mode affinity = config.affinity;
+  return std::thread([=]() {
+    pin_current_thread(index, affinity);
+    body(index);
+  });
+}
+
+// Runs body(index) on config.threads render threads and returns once all of
+// them are done. A single one is the calling thread, so profiles show the
+// plain call stack; it is only pinned while body runs.
+template <typename F>
+void run_render_threads(const batch_config& config, F body) {
+  if (config.threads == 1) {
+    scoped_pin pin(0, config.affinity);
+    body(0);
+    return;
+  }
+  std::vector<std::thread> pool;
+  for (int i = 0; i < config.threads; ++i) pool.push_back(render_thread(config, i, body));
+  for (size_t i = 0; i < pool.size(); ++i) pool[i].join();
+}
+
+// Render farm messages, see net_send
+enum batch_message {
+  msg_hello = 1,  // worker -> coordinator: kBatchProtocol
+  msg_job,        // coordinator -> worker: checkpoint_settings
+  msg_tile,       // coordinator -> worker: tile index
+  msg_result,     // worker -> coordinator: tile index + aov_buffer::data
+  msg_done        // coordinator -> worker: no tiles left
+};
+const uint32_t kBatchProtocol = 0x46524231;  // "1BRF"
+// Tiles a worker connection has queued, so it never waits for the next one
+const size_t kTilesInFlight = 2;
+
+// What a resumed run has to match
+checkpoint_settings make_checkpoint_settings(const settings& s, const batch_config& config, unsigned mask, const exr_options& opt) {
+  checkpoint_settings cs;
+  cs.width = s.window_width;
+  cs.height = s.window_height;
+  cs.samples = s.num_samples;
+  cs.scene_index = s.scene_index;
+  cs.max_sample_luminance = s.max_sample_luminance;
+  cs.seed = config.seed;
+  cs.tile_size = config.tile;
+  cs.aov_mask = mask;
+  cs.pixel_type = opt.pixel_type;
+  cs.compression = opt.compression;
+  return cs;
+}
+
+// Takes over the settings of a job or checkpoint
+void apply_checkpoint_settings(const checkpoint_settings& cs, settings& s, batch_config& config, unsigned& mask, exr_options& opt) {
+  s.window_width = cs.width;
+  s.window_height = cs.height;
+  s.num_samples = cs.samples;
+  s.scene_index = cs.scene_index;
+  s.max_sample_luminance = cs.max_sample_luminance;
+  config.seed = cs.seed;
+  config.tile = cs.tile_size;
+  mask = cs.aov_mask;
+  opt.pixel_type = exr_pixel_type(cs.pixel_type);
+  opt.compression = exr_compression(cs.compression);
+}
+
+// The fixed point sums of a pixel overflow past kAccumMaxSamples, see
+// integrator.h
+bool check_sample_count(int samples) {
+  if (samples >= 1 && samples <= kAccumMaxSamples) return true;
+  fprintf(stderr, "%d samples per pixel is out of range, batch renders take 1 to %d\n", samples, kAccumMaxSamples);
+  return false;
+}
+
+// Renders tile 't' into 'tile' (one tile of tile_size). Samples are drawn
+// and summed as accumulate_pixel does for a partial render, so the beauty is
+// bitwise the same whether the tile is rendered here, by a worker or merged
+// from sample ranges.
+void render_tile(camera* view, hittable* world, hittable* light, settings* s, uint32_t seed, int t, aov_buffer& tile) {
+  int tiles_x = (s->window_width + tile.tile_size - 1) / tile.tile_size;
+  int x0 = (t % tiles_x) * tile.tile_size, y0 = (t / tiles_x) * tile.tile_size;
+  int x1 = std::min(s->window_width, x0 + tile.tile_size), y1 = std::min(s->window_height, y0 + tile.tile_size);
+  bool want_features = tile.mask != aov_bit(aov_beauty);
+  for (int py = y0; py < y1; ++py) {
+    for (int px = x0; px < x1; ++px) {
+      pixel_accum acc;
+      memset(&acc, 0, sizeof(acc));
+      pixel_features pf;
+      accumulate_pixel(view, world, light, px, py, s, seed, 0, s->num_samples, acc, want_features ? &pf : nullptr);
+      pf.samples = int(acc.samples);
+      tile.store(px - x0, py - y0, resolve_accum(acc), pf);
+    }
+  }
+}
+
+// Tiles still to render, shared by the local threads and the connections
+// to workers. A tile taken is either finished or given back.
+struct tile_queue {
+  std::mutex mux;
+  std::condition_variable changed;
+  std::deque<int> pending;
+  int unfinished = 0;
+
+  // Waits for a tile; false once every tile is finished
+  bool take(int& t) {
+    std::unique_lock<std::mutex> lock(mux);
+    changed.wait(lock, [this]() { return !pending.empty() || unfinished == 0; });
+    if (pending.empty()) return false;
+    t = pending.front();
+    pending.pop_front();
+    return true;
+  }
+
+  bool try_take(int& t) {
+    std::lock_guard<std::mutex> lock(mux);
+    if (pending.empty()) return false;
+    t = pending.front();
+    pending.pop_front();
+    return true;
+  }
+
+  void give_back(int t) {
+    std::lock_guard<std::mutex> lock(mux);
+    pending.push_front(t);
+    changed.notify_one();
+  }
+
+  void finish() {
+    std::lock_guard<std::mutex> lock(mux);
+    if (--unfinished == 0) changed.notify_all();
+  }
+
+  bool all_finished() {
+    std::lock_guard<std::mutex> lock(mux);
+    return unfinished == 0;
+  }
+};
+
+// Connects to the coordinator and receives the job
+net_socket join_farm(const char* address, checkpoint_settings& job) {
+  net_socket sock = net_connect(address);
+  if (sock == kNoSocket) return kNoSocket;
+  net_message m;
+  if (!net_send(sock, msg_hello, &kBatchProtocol, sizeof(kBatchProtocol)) ||
+      !net_recv(sock, m, sizeof(job)) || m.type != msg_job || m.payload.size() != sizeof(job)) {
+    net_close(sock);
+    return kNoSocket;
+  }
+  memcpy(&job, m.payload.data(), sizeof(job));
+  return sock;
+}
+
+// Worker side of the farm: renders whatever tiles the coordinator sends
+int run_worker(const batch_config& config, settings& s) {
+  checkpoint_settings job;
+  net_socket first = join_farm(config.coordinator, job);
+  if (first == kNoSocket) {
+    fprintf(stderr, "Could not join %s\n", config.coordinator);
+    return 1;
+  }
+  batch_config job_config = config;
+  unsigned mask;
+  exr_options opt;
+  apply_checkpoint_settings(job, s, job_config, mask, opt);
+  if (!check_sample_count(s.num_samples)) return 1;
+  s.inv_num_samples = 1.0 / s.num_samples;
+
+  scene_replicas scenes;
+  build_scene_replicas(s.scene_index, &s, job.seed, config.numa, scenes);
+  fprintf(stderr, "%s, %dx%d, %d spp, %d thread(s) working for %s\n", scene_name(s.scene_index),
+          s.window_width, s.window_height, s.num_samples, config.threads, config.coordinator);
+
+  std::atomic<int> rendered(0);
+  auto connection = [&](int index, net_socket sock) {
+    const scene_instance& scene = scenes.for_thread(index, config.affinity);
+    checkpoint_settings other;
+    if (sock == kNoSocket) sock = join_farm(config.coordinator, other);
+    if (sock == kNoSocket) return;
+    aov_buffer tile(job.tile_size, job.tile_size, mask, job.tile_size);
+    std::vector<uint8_t> result(sizeof(int32_t) + tile.data.size() * sizeof(float));
+    net_message m;
+    while (net_recv(sock, m, sizeof(int32_t)) && m.type == msg_tile && m.payload.size() == sizeof(int32_t)) {
+      int32_t t;
+      memcpy(&t, m.payload.data(), sizeof(t));
+      render_tile(scene.view, scene.world, scene.light, &s, job.seed, t, tile);
+      memcpy(result.data(), &t, sizeof(t));
+      memcpy(result.data() + sizeof(t), tile.data.data(), tile.data.size() * sizeof(float));
+      if (!net_send(sock, msg_result, result.data(), uint32_t(result.size()))) break;
+      rendered++;
+    }
+    net_close(sock);
+  };
+
+  run_render_threads(config, [&connection, first](int index) { connection(index, index == 0 ? first : kNoSocket); });
+  fprintf(stderr, "Rendered %d tiles\n", int(rendered));
+  return 0;
+}
+
+// Renders samples [first_sample, first_sample + sample_count) of every pixel
+// into an accumulation file
+int render_partial(const batch_config& config, settings& s, const checkpoint_settings& job) {
+  int first = config.first_sample, count = config.sample_count;
+  if (first < 0 || first % kSampleBlock != 0 || first + count > s.num_samples ||
+      (count % kSampleBlock != 0 && first + count != s.num_samples)) {
+    fprintf(stderr, "Sample ranges must start and end on multiples of %d (or at spp=%d)\n", kSampleBlock, s.num_samples);
+    return 1;
+  }
+  std::string path = config.out;
+
+  scene_replicas scenes;
+  build_scene_replicas(s.scene_index, &s, config.seed, config.numa, scenes);
+
+  accum_file out;
+  if (!out.create(path.c_str(), job, first, count)) {
+    fprintf(stderr, "Could not open %s\n", path.c_str());
+    return 1;
+  }
+  int tile_count = out.tiles_x * out.tiles_y;
+  fprintf(stderr, "%s, %dx%d, samples %d-%d of %d, %d tiles of %d, %d thread(s)\n", scene_name(s.scene_index),
+          s.window_width, s.window_height, first, first + count - 1, s.num_samples, tile_count, config.tile, config.threads);
+
+  tile_queue queue;
+  for (int t = 0; t < tile_count; ++t) queue.pending.push_back(t);
+  queue.unfinished = tile_count;
+  std::atomic<int> finished(0);
+  std::atomic<bool> failed(false);
+  auto worker = [&](int index) {
+    const scene_instance& scene = scenes.for_thread(index, config.affinity);
+    std::vector<pixel_accum> tile(out.tile_pixels);
+    int t;
+    while (queue.take(t)) {
+      memset(tile.data(), 0, tile.size() * sizeof(pixel_accum));
+      int x0 = (t % out.tiles_x) * config.tile, y0 = (t / out.tiles_x) * config.tile;
+      int x1 = std::min(s.window_width, x0 + config.tile), y1 = std::min(s.window_height, y0 + config.tile);
+      for (int py = y0; py < y1; ++py)
+        for (int px = x0; px < x1; ++px)
+          accumulate_pixel(scene.view, scene.world, scene.light, px, py, &s, job.seed, first, count, tile[(py - y0) * config.tile + px - x0]);
+      if (!out.write_tile(t, tile.data())) failed = true;
+      int done = ++finished;
+      if (done % 64 == 0 || done == tile_count)
+        fprintf(stderr, "\r%d/%d tiles", done, tile_count);
+      queue.finish();
+    }
+  };
+
+  auto t0 = std::chrono::high_resolution_clock::now();
+  run_render_threads(config, worker);
+  double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - t0).count();
+
+  bool ok = out.close() && !failed;
+  fprintf(stderr, "\n%s %s in %.2f seconds\n", ok ? "Wrote" : "Failed to write", path.c_str(), seconds);
+  return ok ? 0 : 1;
+}
+
+// Adds up the partial renders listed in config.merge and writes the image
+int merge_partials(const batch_config& config) {
+  std::vector<std::unique_ptr<accum_file>> parts;
+  for (const char* p = config.merge; *p != '\0';) {
+    const char* comma = strchr(p, ',');
+    std::string path = comma != nullptr ? std::string(p, comma - p) : std::string(p);
+    parts.push_back(std::unique_ptr<accum_file>(new accum_file()));
+    if (!parts.back()->open(path.c_str())) {
+      fprintf(stderr, "%s is not a finished partial render\n", path.c_str());
+      return 1;
+    }
+    if (memcmp(&parts.back()->header.job, &parts[0]->header.job, sizeof(checkpoint_settings)) != 0) {
+      fprintf(stderr, "%s belongs to a different render\n", path.c_str());
+      return 1;
+    }
+    if (comma == nullptr) break;
+    p = comma + 1;
+  }
+  if (parts.empty()) {
+    fprintf(stderr, "Nothing to merge\n");
+    return 1;
+  }
+
+  // The ranges have to tile [0, spp) exactly, or some samples are missing
+  // or counted twice
+  const checkpoint_settings& job = parts[0]->header.job;
+  std::vector<std::pair<int, int>> ranges;
+  for (size_t i = 0; i < parts.size(); ++i)
+    ranges.push_back(std::make_pair(parts[i]->header.first_sample, parts[i]->header.sample_count));
+  std::sort(ranges.begin(), ranges.end());
+  int covered = 0;
+  for (size_t i = 0; i < ranges.size(); ++i) {
+    if (ranges[i].first != covered) {
+      fprintf(stderr, "Samples %d-%d are %s\n", std::min(covered, ranges[i].first), std::max(covered, ranges[i].first) - 1,
+              ranges[i].first > covered ? "missing" : "rendered twice");
+      return 1;
+    }
+    covered += ranges[i].second;
+  }
+  if (!check_sample_count(job.samples)) return 1;
+  if (covered != job.samples) {
+    fprintf(stderr, "Samples %d-%d are missing\n", covered, job.samples - 1);
+    return 1;
+  }
+
+  unsigned mask = job.aov_mask & (aov_bit(aov_beauty) | aov_bit(aov_sample_count));
+  if (mask != job.aov_mask)
+    fprintf(stderr, "Only beauty and sample_count can be merged, the other AOVs are left out\n");
+  exr_options opt;
+  opt.pixel_type = exr_pixel_type(job.pixel_type);
+  opt.compression = exr_compression(job.compression);
+  opt.tiled = true;
+  opt.tile_size = job.tile_size;
+  std::vector<std::vector<float>> layout_planes;
+  std::vector<exr_channel> layout = aov_exr_channels(aov_buffer(1, 1, mask), layout_planes, opt.pixel_type);
+  exr_tile_stream out;
+  if (!out.open(config.out, job.width, job.height, layout, opt)) {
+    fprintf(stderr, "Could not open %s\n", config.out);
+    return 1;
+  }
+  int tile_count = out.tiles_x * out.tiles_y;
+  fprintf(stderr, "Merging %d partial render(s), %dx%d, %d spp\n", int(parts.size()), job.width, job.height, job.samples);
+
+  tile_queue queue;
+  for (int t = 0; t < tile_count; ++t) queue.pending.push_back(t);
+  queue.unfinished = tile_count;
+  std::atomic<bool> failed(false);
+  auto worker = [&](int) {
+    std::vector<pixel_accum> sum(parts[0]->tile_pixels), part(parts[0]->tile_pixels);
+    aov_buffer tile(job.tile_size, job.tile_size, mask, job.tile_size);
+    std::vector<std::vector<float>> planes;
+    int t;
+    while (queue.take(t)) {
+      memset(sum.data(), 0, sum.size() * sizeof(pixel_accum));
+      for (size_t i = 0; i < parts.size(); ++i) {
+        if (!parts[i]->read_tile(t, part.data())) failed = true;
+        for (size_t k = 0; k < sum.size(); ++k) merge_accum(sum[k], part[k]);
+      }
+      for (int y = 0; y < job.tile_size; ++y) {
+        for (int x = 0; x < job.tile_size; ++x) {
+          const pixel_accum& a = sum[y * job.tile_size + x];
+          pixel_features pf;
+          pf.samples = int(a.samples);
+          tile.store(x, y, resolve_accum(a), pf);
+        }
+      }
+      if (!out.write_tile(t % out.tiles_x, t / out.tiles_x, aov_exr_channels(tile, planes, opt.pixel_type))) failed = true;
+      queue.finish();
+    }
+  };
+  run_render_threads(config, worker);
+
+  bool ok = out.close() && !failed;
+  fprintf(stderr, "%s %s\n", ok ? "Wrote" : "Failed to write", config.out);
+  return ok ? 0 : 1;
+}
+
+// The options of RayTracerBatch on top of those of settings.h
+const std::vector<program_option> batch_options = {
+  { "checkpoint", false, "  --checkpoint <s>      seconds between checkpoints, 0 disables\n" },
+  { "resume", true, "  --resume              continue from <output>.exr.ckpt\n" },
+  { "serve", false, "  --serve <port>        hand tiles out to the workers of a render farm\n" },
+  { "timeout", false, "  --timeout <s>         seconds a farm worker may stay silent, 0 waits forever\n" },
+  { "connect", false, "  --connect <host:port> work for a render farm coordinator\n" },
+  { "samples", false, "  --samples <first:count>  render these samples into <output>_<first>.acc\n" },
+  { "merge", false, "  --merge <a.acc,b.acc,...>  add up partial renders into <output>.exr\n" }
+};
+
+// Takes the value of one of batch_options into 'config'
+bool apply_batch_option(batch_config& config, const std::string& name, const char* value) {
+  char* end = nullptr;
+  if (name == "resume") {
+    config.resume = true;
+    return true;
+  }
+  if (name == "checkpoint") {
+    config.checkpoint_seconds = strtod(value, &end);
+    if (end != value && *end == '\0' && config.checkpoint_seconds >= 0.0) return true;
+  }
+  else if (name == "serve") {
+    long port = strtol(value, &end, 10);
+    if (end != value && *end == '\0' && port >= 1 && port <= 65535) {
+      config.serve_port = int(port);
+      return true;
+    }
+  }
+  else if (name == "timeout") {
+    long seconds = strtol(value, &end, 10);
+    if (end != value && *end == '\0' && seconds >= 0 && seconds <= INT_MAX) {
+      config.worker_timeout = int(seconds);
+      return true;
+    }
+  }
+  else if (name == "connect") {
+    config.coordinator = value;
+    return true;
+  }
+  else if (name == "samples") {
+    if (sscanf(value, "%d:%d", &config.first_sample, &config.sample_count) == 2 && config.sample_count >= 1) return true;
+  }
+  else if (name == "merge") {
+    config.merge = value;
+    return true;
+  }
+  fprintf(stderr, "Bad value '%s' for --%s\n", value, name.c_str());
+  return false;
+}
+
+int main(int argc, char** argv) {
+  batch_config config;
+  settings s = ReadSettings(SettingsPath(argc, argv));
+  auto take = [&config](const std::string& name, const char* value) { return apply_batch_option(config, name, value); };
+  if (!ParseCommandLine(s, argc, argv, batch_options, take)) return 1;
+  config.tile = s.tile_size;
+  config.threads = RenderThreads(s);
+  config.affinity = thread_affinity(s);
+  config.numa = s.numa;
+  config.seed = s.seed;
+
+  if (config.tile < 1) config.tile = 64;
+  std::string out_path = s.output + (config.sample_count > 0 ? "_" + std::to_string(config.first_sample) + ".acc" : ".exr");
+  config.out = out_path.c_str();
+  // A coordinator only renders when given a thread count. multithreaded=false
+  // alone forces one thread for rendering but doesn't ask for any here.
+  bool threads_given = s.multithreaded ? s.threads > 0 : s.threads == 1;
+  if (config.serve_port > 0 && !threads_given) config.threads = 0;
+
+  if ((config.serve_port > 0 || config.coordinator != nullptr) && !net_init()) {
+    fprintf(stderr, "Could not start networking\n");
+    return 1;
+  }
+  if (config.coordinator != nullptr) return run_worker(config, s);
+
+  exr_options opt;
+  opt.pixel_type = s.exr_pixel_type == "float" ? exr_float : exr_half;
+  opt.compression = s.exr_compression == "none" ? exr_no_compression : (s.exr_compression == "zips" ? exr_zips : exr_zip);
+  opt.tiled = true;
+  unsigned mask = parse_aov_list(s.aovs);
+
+  std::string checkpoint_path = std::string(config.out) + ".ckpt";
+  batch_checkpoint resumed;
+  if (config.resume) {
+    if (!load_checkpoint(checkpoint_path.c_str(), resumed)) {
+      fprintf(stderr, "Could not read checkpoint %s\n", checkpoint_path.c_str());
+      return 1;
+    }
+    // The checkpoint wins over settings.ini and the command line
+    apply_checkpoint_settings(resumed.settings, s, config, mask, opt);
+  }
+  s.inv_num_samples = 1.0 / s.num_samples;
+  opt.tile_size = config.tile;
+
+  if (config.merge != nullptr) return merge_partials(config);
+  if (!check_sample_count(s.num_samples)) return 1;
+  if (config.sample_count > 0) {
+    if (config.resume || config.serve_port > 0) {
+      fprintf(stderr, "--samples can't be combined with --resume or --serve\n");
+      return 1;
+    }
+    return render_partial(config, s, make_checkpoint_settings(s, config, mask, opt));
+  }
+
+  // A coordinator that doesn't render needs no scene
+  scene_replicas scenes;
+  if (config.threads > 0)
+    build_scene_replicas(s.scene_index, &s, config.seed, config.numa, scenes);
+
+  // The layout of one tile describes the channels of the whole file
+  std::vector<std::vector<float>> layout_planes;
+  std::vector<exr_channel> layout = aov_exr_channels(aov_buffer(1, 1, mask), layout_planes, opt.pixel_type);
+  exr_tile_stream out;
+  if (config.resume) {
+    if (!out.resume(config.out, s.window_width, s.window_height, layout, opt, resumed.tile_offsets, resumed.file_end)) {
+      fprintf(stderr, "%s does not match its checkpoint\n", config.out);
+      return 1;
+    }
+  }
+  else if (!out.open(config.out, s.window_width, s.window_height, layout, opt)) {
+    fprintf(stderr, "Could not open %s\n", config.out);
+    return 1;
+  }
+
+  int tile_count = out.tiles_x * out.tiles_y;
+  int already_done = 0;
+  for (int t = 0; t < tile_count; ++t)
+    if (out.offsets[t] != 0) already_done++;
+  fprintf(stderr, "%s, %dx%d, %d spp, %d tiles of %d, %d thread(s)\n", scene_name(s.scene_index),
+          s.window_width, s.window_height, s.num_samples, tile_count, config.tile, config.threads);
+  if (config.serve_port > 0)
+    fprintf(stderr, "Serving tiles on port %d\n", config.serve_port);
+  if (config.resume)
+    fprintf(stderr, "Resuming with %d tiles done\n", already_done);
+
+  batch_checkpoint checkpoint;
+  checkpoint.settings = make_checkpoint_settings(s, config, mask, opt);
+  std::mutex checkpoint_mux;
+  auto last_checkpoint = std::chrono::steady_clock::now();
+  // Called between tiles; at most one thread writes a checkpoint at a time
+  // and the others carry on rendering
+  auto maybe_checkpoint = [&]() {
+    if (config.checkpoint_seconds <= 0.0) return;
+    std::unique_lock<std::mutex> lock(checkpoint_mux, std::try_to_lock);
+    if (!lock.owns_lock()) return;
+    auto now = std::chrono::steady_clock::now();
+    if (std::chrono::duration<double>(now - last_checkpoint).count() < config.checkpoint_seconds) return;
+    out.snapshot(checkpoint.tile_offsets, checkpoint.file_end);
+    // The tiles have to be on disk before a checkpoint refers to them
+    if (!sync_file(out.file) || !save_checkpoint(checkpoint_path.c_str(), checkpoint))
+      fprintf(stderr, "\nCould not write checkpoint %s\n", checkpoint_path.c_str());
+    last_checkpoint = now;
+  };
+
+  tile_queue queue;
+  // Tiles finished before the checkpoint this run resumed from are skipped
+  for (int t = 0; t < tile_count; ++t)
+    if (out.offsets[t] == 0) queue.pending.push_back(t);
+  queue.unfinished = int(queue.pending.size());
+
+  std::atomic<int> finished(already_done);
+  std::atomic<bool> failed(false);
+  auto finish_tile = [&](int t, const aov_buffer& tile, std::vector<std::vector<float>>& planes) {
+    if (!out.write_tile(t % out.tiles_x, t / out.tiles_x, aov_exr_channels(tile, planes, opt.pixel_type))) failed = true;
+    int done = ++finished;
+    if (done % 64 == 0 || done == tile_count)
+      fprintf(stderr, "\r%d/%d tiles", done, tile_count);
+    maybe_checkpoint();
+    queue.finish();
+  };
+
+  auto worker = [&](int index) {
+    const scene_instance& scene = scenes.for_thread(index, config.affinity);
+    aov_buffer tile(config.tile, config.tile, mask, config.tile);
+    std::vector<std::vector<float>> planes;
+    int t;
+    while (queue.take(t)) {
+      render_tile(scene.view, scene.world, scene.light, &s, config.seed, t, tile);
+      finish_tile(t, tile, planes);
+    }
+  };
+
+  // Feeds one remote worker connection; tiles it still holds when the
+  // connection drops, or when the worker goes quiet for worker_timeout
+  // seconds, go back to the queue
+  auto serve_worker = [&](net_socket sock) {
+    if (config.worker_timeout > 0) net_set_timeout(sock, config.worker_timeout);
+    net_message m;
+    if (!net_recv(sock, m, sizeof(kBatchProtocol)) || m.type != msg_hello || m.payload.size() != sizeof(kBatchProtocol) ||
+        memcmp(m.payload.data(), &kBatchProtocol, sizeof(kBatchProtocol)) != 0 ||
+        !net_send(sock, msg_job, &checkpoint.settings, sizeof(checkpoint.settings))) {
+      net_close(sock);
+      return;
+    }
+    aov_buffer tile(config.tile, config.tile, mask, config.tile);
+    std::vector<std::vector<float>> planes;
+    uint32_t result_size = uint32_t(sizeof(int32_t) + tile.data.size() * sizeof(float));
+    std::deque<int> in_flight;
+    bool lost = false;
+    for (;;) {
+      int t;
+      while (in_flight.size() < kTilesInFlight && (in_flight.empty() ? queue.take(t) : queue.try_take(t))) {
+        int32_t index = t;
+        in_flight.push_back(t);
+        if (!net_send(sock, msg_tile, &index, sizeof(index))) {
+          lost = true;
+          break;
+        }
+      }
+      if (lost || in_flight.empty()) break;
+      int32_t index;
+      if (!net_recv(sock, m, result_size) || m.type != msg_result || m.payload.size() != result_size ||
+          (memcpy(&index, m.payload.data(), sizeof(index)), index != in_flight.front())) {
+        lost = true;
+        break;
+      }
+      memcpy(tile.data.data(), m.payload.data() + sizeof(index), tile.data.size() * sizeof(float));
+      in_flight.pop_front();
+      finish_tile(index, tile, planes);
+    }
+    if (lost) {
+      if (!in_flight.empty())
+        fprintf(stderr, "\nLost a worker (gone or silent for %d s), handing its %d tile(s) to the others\n",
+                config.worker_timeout, int(in_flight.size()));
+      for (size_t i = 0; i < in_flight.size(); ++i) queue.give_back(in_flight[i]);
+    }
+    else {
+      net_send(sock, msg_done, nullptr, 0);
+    }
+    net_close(sock);
+  };
+
+  net_socket listener = kNoSocket;
+  if (config.serve_port > 0) {
+    listener = net_listen(config.serve_port);
+    if (listener == kNoSocket) {
+      fprintf(stderr, "Could not listen on port %d\n", config.serve_port);
+      return 1;
+    }
+  }
+
+  auto t0 = std::chrono::high_resolution_clock::now();
+  if (listener != kNoSocket) {
+    // This thread takes the workers' connections, the local tiles render
+    // on threads of their own
+    std::vector<std::thread> pool;
+    for (int i = 0; i < config.threads; ++i) pool.push_back(render_thread(config, i, worker));
+    while (!queue.all_finished()) {
+      net_socket sock = net_accept(listener, 200);
+      if (sock != kNoSocket) pool.push_back(std::thread(serve_worker, sock));
+    }
+    net_close(listener);
+    for (size_t i = 0; i < pool.size(); ++i) pool[i].join();
+  }
+  else {
+    run_render_threads(config, worker);
+  }
+  double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - t0).count();
+
+  bool ok = out.close() && !failed;
+  fprintf(stderr, "\n%s %s in %.2f seconds\n", ok ? "Wrote" : "Failed to write", config.out, seconds);
+  if (ok) remove(checkpoint_path.c_str());
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,358 @@
+/* Author: Diego Cosin <cosinma@esat-alumni.com>. */
+
+// End-to-end render benchmark. Renders the built-in scenes headless at a
+// fixed resolution, sample count and seed for each requested thread count,
+// and prints the results as JSON so runs on different builds or machines can
+// be diffed.
+//
+// Rows are handed out dynamically, but the generator is reseeded from the
+// seed and row index before every row, so the image (and its hash) only
+// depends on the settings, never on the thread count or scheduling.
+//
+// dispatch= changes what a thread takes at a time, to measure how the way
+// pixels are written scales with the thread count:
+//   rows    a row, written straight into the image (the default)
+//   pixels  a single pixel, written straight into the image next to the
+//           pixels of other threads, as the viewer did; threads draw from
+//           their own generators, so the hash changes from run to run
+//   runs    kRunPixels pixels of a row, rendered into the thread's
+//           pixel_run and copied out in whole cache lines, as the viewer
+//           does (framebuffer.h); reseeded per run
+// Run it with threads=1,8,16,32,64 to compare them past 16 threads. Only
+// the writes are compared; the viewer also hands every run over through a
+// condition variable.
+//
+// Usage: RayTracerRenderBench [key=value ...]
+//   scene=all|0|1|2  width=256  height=256  spp=16  seed=1
+//   threads=1,N      runs=1     out=<file>   (JSON goes to stdout by default)
+//   trace=<file>     Chrome trace of every run, one event per row or run
+//   dispatch=rows|pixels|runs  thread_rows counts what each thread took
+//   numa=0|1         a copy of the scene per NUMA node (numa.h)
+//   affinity=none|cores|nodes  pin the workers; nodes when numa=1 by default
+//
+// Build with RT_STATS=1 to add the hot-path counters (stats.h) of the
+// reported run to every result.
+//
+// Peak RSS is the process high-water mark when each result was taken, so it
+// includes every scene built before it.
+
+#define _CRT_SECURE_NO_WARNINGS
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+#include <memory>
+#include "scenes.h"
+#include "integrator.h"
+#include "stats.h"
+#include "trace.h"
+#include "numa.h"
+#include "framebuffer.h"
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+size_t peak_rss_bytes() {
+#ifdef _WIN32
+  PROCESS_MEMORY_COUNTERS counters;
+  if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+    return counters.PeakWorkingSetSize;
+  return 0;
+#else
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+  return size_t(usage.ru_maxrss);
+#else
+  return size_t(usage.ru_maxrss) * 1024;
+#endif
+#endif
+}
+
+enum dispatch_mode {
+  dispatch_rows,
+  dispatch_pixels,
+  dispatch_runs
+};
+
+const char* dispatch_names[] = { "rows", "pixels", "runs" };
+
+struct bench_config {
+  std::vector<int> scenes;
+  std::vector<int> threads;
+  int width = 256;
+  int height = 256;
+  int spp = 16;
+  uint32_t seed = 1;
+  int runs = 1;
+  const char* out = nullptr;
+  const char* trace = nullptr;
+  bool numa = false;
+  const char* affinity = "none";
+  dispatch_mode dispatch = dispatch_rows;
+};
+
+struct thread_result {
+  double busy_seconds = 0.0;
+  int rows = 0;
+  ray_counter rays;
+};
+
+struct run_result {
+  double wall_seconds = 0.0;
+  uint64_t image_hash = 0;
+  std::vector<thread_result> threads;
+  render_stats stats;
+};
+
+// FNV-1a over the float bits of the image
+uint64_t hash_image(const float* image, size_t count) {
+  uint64_t h = 14695981039346656037ull;
+  const uint8_t* bytes = reinterpret_cast<const uint8_t*>(image);
+  for (size_t i = 0; i < count * sizeof(float); ++i) {
+    h ^= bytes[i];
+    h *= 1099511628211ull;
+  }
+  return h;
+}
+
+inline void store_rgb(float* out, const vec4& col) {
+  out[0] = float(col.r);
+  out[1] = float(col.g);
+  out[2] = float(col.b);
+}
+
+run_result render(const scene_replicas& scenes, affinity_mode affinity, dispatch_mode dispatch, settings* s, uint32_t seed, int nthreads) {
+  typedef std::chrono::high_resolution_clock clock;
+  int width = s->window_width, height = s->window_height;
+  // Left uninitialized so every row is first touched by the thread rendering it
+  size_t image_size = size_t(3) * width * height;
+  std::unique_ptr<float, void (*)(float*)> image((float*)_mm_malloc(image_size * sizeof(float), kCacheLine), free_framebuffer);
+  int runs_x = (width + kRunPixels - 1) / kRunPixels;
+  int items = dispatch == dispatch_rows ? height : dispatch == dispatch_runs ? runs_x * height : width * height;
+  std::atomic<int> next_item(0);
+  run_result result;
+  result.threads.resize(nthreads);
+
+  auto worker = [&](int id) {
+    thread_result& mine = result.threads[id];
+    pin_current_thread(id, affinity);
+    const scene_instance& scene = scenes.for_thread(id, affinity);
+    ray_counter start = thread_rays;
+    trace_thread_name("worker " + std::to_string(id));
+    // Counted locally, the results of neighbouring threads share cache lines
+    double busy_seconds = 0.0;
+    int taken = 0;
+    pixel_run run;
+    if (dispatch == dispatch_pixels) seed_random(seed * 2654435761u + uint32_t(id) + 1u);
+    for (;;) {
+      int item = next_item++;
+      if (item >= items) break;
+      auto t0 = clock::now();
+      if (dispatch == dispatch_rows) {
+        TRACE_SCOPE("row", "render", "y", item);
+        seed_random(seed * 2654435761u + uint32_t(item));
+        for (int px = 0; px < width; ++px)
+          store_rgb(&image.get()[3 * (size_t(width) * item + px)], sample_pixel(scene.view, scene.world, scene.light, px, item, s));
+      }
+      else if (dispatch == dispatch_runs) {
+        int py = item / runs_x, x0 = (item % runs_x) * kRunPixels;
+        TRACE_SCOPE("run", "render", "x", x0, "y", py);
+        seed_random(seed * 2654435761u + uint32_t(item));
+        run.begin(x0, run_width(x0, 1, width), 3);
+        for (int px = x0; px < x0 + run.width; ++px)
+          store_rgb(run.at(px), sample_pixel(scene.view, scene.world, scene.light, px, py, s));
+        run.flush(image.get(), width, py, py + 1);
+      }
+      else {
+        int px = item % width, py = item / width;
+        store_rgb(&image.get()[3 * size_t(item)], sample_pixel(scene.view, scene.world, scene.light, px, py, s));
+      }
+      busy_seconds += std::chrono::duration<double>(clock::now() - t0).count();
+      taken++;
+    }
+    mine.busy_seconds = busy_seconds;
+    mine.rows = taken;
+    mine.rays.primary = thread_rays.primary - start.primary;
+    mine.rays.total = thread_rays.total - start.total;
+    mine.rays.invalid = thread_rays.invalid - start.invalid;
+  };
+
+  reset_stats();
+  auto t0 = clock::now();
+  std::vector<std::thread> pool;
+  for (int i = 0; i < nthreads; ++i) pool.push_back(std::thread(worker, i));
+  for (size_t i = 0; i < pool.size(); ++i) pool[i].join();
+  result.wall_seconds = std::chrono::duration<double>(clock::now() - t0).count();
+  result.image_hash = hash_image(image.get(), image_size);
+  result.stats = gather_stats();
+  return result;
+}
+
+void write_result(FILE* f, const char* scene, int nthreads, double build_seconds, const run_result& r, const settings& s, bool last) {
+  uint64_t primary = 0, total = 0, invalid = 0;
+  for (size_t i = 0; i < r.threads.size(); ++i) {
+    primary += r.threads[i].rays.primary;
+    total += r.threads[i].rays.total;
+    invalid += r.threads[i].rays.invalid;
+  }
+  double samples = double(s.window_width) * double(s.window_height) * double(s.num_samples);
+
+  fprintf(f, "    {\n");
+  fprintf(f, "      \"scene\": \"%s\",\n", scene);
+  fprintf(f, "      \"threads\": %d,\n", nthreads);
+  fprintf(f, "      \"build_seconds\": %.6f,\n", build_seconds);
+  fprintf(f, "      \"wall_seconds\": %.6f,\n", r.wall_seconds);
+  fprintf(f, "      \"primary_rays\": %llu,\n", (unsigned long long)primary);
+  fprintf(f, "      \"total_rays\": %llu,\n", (unsigned long long)total);
+  fprintf(f, "      \"mrays_per_second_primary\": %.4f,\n", primary / r.wall_seconds * 1e-6);
+  fprintf(f, "      \"mrays_per_second_total\": %.4f,\n", total / r.wall_seconds * 1e-6);
+  fprintf(f, "      \"samples_per_second\": %.1f,\n", samples / r.wall_seconds);
+  fprintf(f, "      \"invalid_samples\": %llu,\n", (unsigned long long)invalid);
+  fprintf(f, "      \"peak_rss_bytes\": %llu,\n", (unsigned long long)peak_rss_bytes());
+  fprintf(f, "      \"image_hash\": \"%016llx\",\n", (unsigned long long)r.image_hash);
+  fprintf(f, "      \"thread_utilization\": [");
+  for (size_t i = 0; i < r.threads.size(); ++i)
+    fprintf(f, "%s%.4f", i ? ", " : "", r.threads[i].busy_seconds / r.wall_seconds);
+  fprintf(f, "],\n");
+  fprintf(f, "      \"thread_rows\": [");
+  for (size_t i = 0; i < r.threads.size(); ++i)
+    fprintf(f, "%s%d", i ? ", " : "", r.threads[i].rows);
+#if RT_STATS
+  fprintf(f, "],\n");
+  fprintf(f, "      \"stats\": ");
+  write_stats_json(f, r.stats, 6);
+  fprintf(f, "\n");
+#else
+  fprintf(f, "]\n");
+#endif
+  fprintf(f, "    }%s\n", last ? "" : ",");
+}
+
+std::vector<int> parse_list(const char* text) {
+  std::vector<int> values;
+  while (*text) {
+    values.push_back(atoi(text));
+    const char* comma = strchr(text, ',');
+    if (comma == nullptr) break;
+    text = comma + 1;
+  }
+  return values;
+}
+
+int main(int argc, char** argv) {
+  bench_config config;
+  int hardware = int(std::thread::hardware_concurrency());
+  if (hardware < 1) hardware = 1;
+
+  for (int i = 1; i < argc; ++i) {
+    const char* eq = strchr(argv[i], '=');
+    if (eq == nullptr) {
+      fprintf(stderr, "Ignoring argument '%s', expected key=value\n", argv[i]);
+      continue;
+    }
+    std::string key(argv[i], eq - argv[i]);
+    const char* value = eq + 1;
+    if (key == "scene") { if (strcmp(value, "all") != 0) config.scenes = parse_list(value); }
+    else if (key == "threads") config.threads = parse_list(value);
+    else if (key == "width") config.width = atoi(value);
+    else if (key == "height") config.height = atoi(value);
+    else if (key == "spp") config.spp = atoi(value);
+    else if (key == "seed") config.seed = uint32_t(strtoul(value, nullptr, 10));
+    else if (key == "runs") config.runs = atoi(value);
+    else if (key == "out") config.out = value;
+    else if (key == "trace") config.trace = value;
+    else if (key == "numa") config.numa = atoi(value) != 0;
+    else if (key == "affinity") config.affinity = value;
+    else if (key == "dispatch") {
+      if (strcmp(value, "pixels") == 0) config.dispatch = dispatch_pixels;
+      else if (strcmp(value, "runs") == 0) config.dispatch = dispatch_runs;
+      else if (strcmp(value, "rows") == 0) config.dispatch = dispatch_rows;
+      else fprintf(stderr, "Unknown dispatch '%s', using rows\n", value);
+    }
+    else fprintf(stderr, "Ignoring unknown key '%s'\n", key.c_str());
+  }
+  if (config.scenes.empty()) config.scenes = { 0, 1, 2 };
+  if (config.threads.empty()) {
+    config.threads.push_back(1);
+    if (hardware > 1) config.threads.push_back(hardware);
+  }
+  if (config.runs < 1) config.runs = 1;
+
+  settings s = settings();
+  s.window_width = config.width > 0 ? config.width : 256;
+  s.window_height = config.height > 0 ? config.height : 256;
+  s.num_samples = config.spp > 0 ? config.spp : 16;
+  s.inv_num_samples = 1.0 / s.num_samples;
+  s.multithreaded = true;
+  s.frames = 1;
+  s.numa = config.numa;
+  s.affinity = config.affinity;
+  affinity_mode affinity = thread_affinity(s);
+
+  trace_thread_name("main");
+  if (config.trace != nullptr) trace_start();
+
+  FILE* f = config.out != nullptr ? fopen(config.out, "w") : stdout;
+  if (f == nullptr) {
+    fprintf(stderr, "Could not open %s\n", config.out);
+    return 1;
+  }
+  fprintf(f, "{\n");
+  fprintf(f, "  \"width\": %d,\n", s.window_width);
+  fprintf(f, "  \"height\": %d,\n", s.window_height);
+  fprintf(f, "  \"spp\": %d,\n", s.num_samples);
+  fprintf(f, "  \"seed\": %u,\n", config.seed);
+  fprintf(f, "  \"runs\": %d,\n", config.runs);
+  fprintf(f, "  \"hardware_threads\": %d,\n", hardware);
+  fprintf(f, "  \"dispatch\": \"%s\",\n", dispatch_names[config.dispatch]);
+  fprintf(f, "  \"numa\": %s,\n", config.numa ? "true" : "false");
+  fprintf(f, "  \"numa_nodes\": %d,\n", int(topology().nodes.size()));
+  fprintf(f, "  \"affinity\": \"%s\",\n", affinity == affinity_cores ? "cores" : affinity == affinity_nodes ? "nodes" : "none");
+  fprintf(f, "  \"results\": [\n");
+
+  for (size_t si = 0; si < config.scenes.size(); ++si) {
+    int scene_index = config.scenes[si];
+    scene_replicas scenes;
+
+    // Scene construction draws random numbers too; every copy is built from the seed
+    auto t0 = std::chrono::high_resolution_clock::now();
+    build_scene_replicas(scene_index, &s, config.seed, config.numa, scenes);
+    double build_seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - t0).count();
+
+    for (size_t ti = 0; ti < config.threads.size(); ++ti) {
+      int nthreads = config.threads[ti] > 0 ? config.threads[ti] : 1;
+      // Median wall time over the runs
+      std::vector<run_result> runs;
+      for (int run = 0; run < config.runs; ++run) {
+        fprintf(stderr, "%s, %d thread(s), run %d/%d\n", scene_name(scene_index), nthreads, run + 1, config.runs);
+        TRACE_SCOPE("run", "bench", "threads", nthreads);
+        runs.push_back(render(scenes, affinity, config.dispatch, &s, config.seed, nthreads));
+      }
+      std::sort(runs.begin(), runs.end(), [](const run_result& a, const run_result& b) {
+        return a.wall_seconds < b.wall_seconds;
+      });
+      bool last = si + 1 == config.scenes.size() && ti + 1 == config.threads.size();
+      write_result(f, scene_name(scene_index), nthreads, build_seconds, runs[runs.size() / 2], s, last);
+    }
+  }
+
+  fprintf(f, "  ]\n");
+  fprintf(f, "}\n");
+  if (f != stdout) fclose(f);
+  if (config.trace != nullptr) {
+    trace_stop();
+    if (!trace_write(config.trace)) fprintf(stderr, "Could not write %s\n", config.trace);
+  }
+  return 0;
+}